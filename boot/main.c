@@ -1,5 +1,6 @@
 #include <inc/x86.h>
 #include <inc/elf.h>
+#include <inc/multiboot.h>
 
 /**********************************************************************
  * This a dirt simple boot loader, whose sole job is to boot
@@ -26,7 +27,9 @@
  *  * control starts in boot.S -- which sets up protected mode,
  *    and a stack so C code then run, then calls bootmain()
  *
- *  * bootmain() in this file takes over, reads in the kernel and jumps to it.
+ *  * bootmain() in this file takes over, reads in the kernel and jumps to it
+ *    the way a multiboot loader would, with the memory map boot.S got
+ *    from the BIOS.
  **********************************************************************/
 
 #define SECTSIZE	512
@@ -55,9 +58,11 @@ bootmain(void)
 		// as the physical address)
 		readseg(ph->p_pa, ph->p_memsz, ph->p_offset);
 
-	// call the entry point from the ELF header
+	// call the entry point from the ELF header, with the multiboot
+	// magic in %eax and the info boot.S set up in %ebx
 	// note: does not return!
-	((void (*)(void)) (ELFHDR->e_entry))();
+	asm volatile("jmp *%0" : : "d" (ELFHDR->e_entry),
+		     "a" (MULTIBOOT_BOOTLOADER_MAGIC), "b" (BOOT_MBINFO));
 
 bad:
 	outw(0x8A00, 0x8A00);
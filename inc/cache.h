@@ -0,0 +1,23 @@
+#ifndef JOS_INC_CACHE_H
+#define JOS_INC_CACHE_H
+
+// Cache-line placement of kernel data.
+//
+// __read_mostly collects data that is set up once and then only read
+// (keymaps, configuration, feature flags) into its own section, so it
+// never shares a cache line with data that is written often.
+//
+// __cacheline_aligned starts a frequently written variable on its own
+// cache line, in a section kernel.ld keeps apart from plain .data.
+// ____cacheline_aligned only aligns; use it on struct types, such as
+// per-CPU state indexed by cpunum(), so that each array element starts
+// a new line, and on large zero-filled arrays that belong in .bss.
+
+#define CACHELINE		64	// bytes; x86 since the Pentium 4
+
+#define ____cacheline_aligned	__attribute__((__aligned__(CACHELINE)))
+#define __cacheline_aligned	\
+	____cacheline_aligned __attribute__((__section__(".data.cacheline_aligned")))
+#define __read_mostly		__attribute__((__section__(".data.read_mostly")))
+
+#endif	/* !JOS_INC_CACHE_H */
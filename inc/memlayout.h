@@ -43,6 +43,8 @@
  *                     +------------------------------+                   |
  *                     :              .               :                   |
  *                     :              .               :                   |
+ *                     +------------------------------+                   |
+ *                     |   Per-CPU highmem windows    | RW/--  KMAPSIZE   |
  *    MMIOLIM ------>  +------------------------------+ 0xefc00000      --+
  *                     |       Memory-mapped I/O      | RW/--  PTSIZE
  * ULIM, MMIOBASE -->  +------------------------------+ 0xef800000
@@ -80,6 +82,11 @@
  * (*) Note: The kernel ensures that "Invalid Memory" is *never* mapped.
  *     "Empty Memory" is normally unmapped, but user programs may map pages
  *     there if desired.  JOS user programs map pages temporarily at UTEMP.
+ *
+ * The addresses are those of the two-level build.  With PAE, PTSIZE is
+ * 2MB and the virtual page table takes four of them, so everything
+ * from MMIOLIM down to UTOP moves: UVPT is at 0xef400000 and UTOP at
+ * 0xef000000.
  */
 
 
@@ -97,6 +104,12 @@
 #define KSTKSIZE	(8*PGSIZE)   		// size of a kernel stack
 #define KSTKGAP		(8*PGSIZE)   		// size of a kernel stack guard
 
+// Temporary kernel mappings of highmem pages, KMAP_SLOTS per CPU, at
+// the bottom of the kernel stack region (see kmap in kern/pmap.c).
+#define KMAPBASE	MMIOLIM
+#define KMAP_SLOTS	16
+#define KMAPSIZE	(NCPU * KMAP_SLOTS * PGSIZE)
+
 // Memory-mapped IO.
 #define MMIOLIM		(KSTACKTOP - PTSIZE)
 #define MMIOBASE	(MMIOLIM - PTSIZE)
@@ -108,8 +121,10 @@
  * They are global pages mapped in at env allocation time.
  */
 
-// User read-only virtual page table (see 'uvpt' below)
-#define UVPT		(ULIM - PTSIZE)
+// User read-only virtual page table (see 'uvpt' below), which has an
+// entry for every page: one page directory's worth of page tables.
+#define UVPTSIZE	(NPDENTRIES * PGSIZE)
+#define UVPT		(ULIM - UVPTSIZE)
 // Read-only copies of the Page structures
 #define UPAGES		(UVPT - PTSIZE)
 // Read-only copies of the global env structures
@@ -140,8 +155,64 @@
 
 #ifndef __ASSEMBLER__
 
+#ifdef PAE
+typedef uint64_t pte_t;
+typedef uint64_t pde_t;
+#else
 typedef uint32_t pte_t;
 typedef uint32_t pde_t;
+#endif
+
+/*
+ * Page descriptor structures, mapped at UPAGES.
+ * Read/write to the kernel, read-only to user programs.
+ *
+ * Each struct PageInfo stores metadata for one physical page.
+ * Is it NOT the physical page itself, but there is a one-to-one
+ * correspondence between physical pages and struct PageInfo's.
+ * You can map a struct PageInfo * to the corresponding physical address
+ * with page2pa() in kern/pmap.h.
+ *
+ * Free memory is kept in buddy blocks of 2^order pages.  Only the
+ * first page of a free block is on a free list and has PP_FREE set.
+ * Free single pages may instead sit in a per-CPU cache or pool of
+ * pre-zeroed pages (PP_CACHED).
+ */
+struct PageInfo {
+	// Next and previous blocks on the free list of this order.
+	// For pages that belong to a slab (PP_SLAB), pp_link points to
+	// the slab's first page instead.
+	struct PageInfo *pp_link;
+	struct PageInfo *pp_prev;
+
+	// pp_ref is the count of pointers (usually in page table entries)
+	// to this page, for pages allocated using page_alloc.
+	// Pages allocated at boot time using pmap.c's
+	// boot_alloc do not have valid reference count fields.
+
+	uint16_t pp_ref;
+
+	uint8_t pp_order;	// log2 of the block size in pages
+	uint8_t pp_flags;	// PP_*
+};
+
+#define PP_FREE		0x01	// first page of a free block
+#define PP_CACHED	0x02	// free, in a per-CPU page cache or zero pool
+#define PP_SLAB		0x04	// part of a slab (kern/slab.c)
+
+/*
+ * One run of pages for page_map_batch() to map: pm_npages pages from
+ * pm_srcva in the source address space to pm_dstva in the destination,
+ * with permissions pm_perm.  The kernel reports the outcome of each
+ * run in its pm_status.
+ */
+struct PageMapRange {
+	uintptr_t pm_srcva;	// page-aligned, below UTOP
+	uintptr_t pm_dstva;	// page-aligned, below UTOP
+	size_t pm_npages;
+	int pm_perm;		// PTE_U | PTE_P, plus other PTE_SYSCALL bits
+	int pm_status;		// 0 or -E_*
+};
 
 #endif /* !__ASSEMBLER__ */
 #endif /* !JOS_INC_MEMLAYOUT_H */
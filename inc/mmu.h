@@ -25,15 +25,38 @@
 // The PDX, PTX, PGOFF, and PGNUM macros decompose linear addresses as shown.
 // To construct a linear address la from PDX(la), PTX(la), and PGOFF(la),
 // use PGADDR(PDX(la), PTX(la), PGOFF(la)).
+//
+// A kernel built with PAE defined ('make PAE=1') uses Physical Address
+// Extension paging instead.  Entries are 64 bits wide, so physical
+// addresses can reach past 4GB and bit 63 can be PTE_NX, and tables
+// hold 512 entries, so a linear address has a four-part structure:
+//
+// +--2--+-----9-----+-------9--------+---------12----------+
+// | PDP | Page Dir  |   Page Table   | Offset within Page  |
+// |Index|   Index   |      Index     |                     |
+// +-----+-----------+----------------+---------------------+
+//  \PDPX/
+//  \---- PDX(la) ---/ \--- PTX(la) --/ \---- PGOFF(la) ----/
+//
+// The page directory pointer table in %cr3 selects one of four page
+// directories.  The kernel keeps a page directory's four pages next to
+// each other and treats them as one 2048-entry page directory, so
+// PDX(la) spans both upper fields and pgdir[PDX(la)] means the same
+// thing in either build.
 
 // page number field of address
 #define PGNUM(la)	(((uintptr_t) (la)) >> PTXSHIFT)
 
 // page directory index
-#define PDX(la)		((((uintptr_t) (la)) >> PDXSHIFT) & 0x3FF)
+#define PDX(la)		((((uintptr_t) (la)) >> PDXSHIFT) & (NPDENTRIES - 1))
 
 // page table index
-#define PTX(la)		((((uintptr_t) (la)) >> PTXSHIFT) & 0x3FF)
+#define PTX(la)		((((uintptr_t) (la)) >> PTXSHIFT) & (NPTENTRIES - 1))
+
+#ifdef PAE
+// page directory pointer table index
+#define PDPX(la)	(((uintptr_t) (la)) >> PDPXSHIFT)
+#endif
 
 // offset in page
 #define PGOFF(la)	(((uintptr_t) (la)) & 0xFFF)
@@ -42,17 +65,28 @@
 #define PGADDR(d, t, o)	((void*) ((d) << PDXSHIFT | (t) << PTXSHIFT | (o)))
 
 // Page directory and page table constants.
+#ifdef PAE
+#define NPDPENTRIES	4		// entries in the page directory pointer table
+#define NPDENTRIES	2048		// entries in all four page directories
+#define NPTENTRIES	512		// page table entries per page table
+#else
 #define NPDENTRIES	1024		// page directory entries per page directory
 #define NPTENTRIES	1024		// page table entries per page table
+#endif
 
 #define PGSIZE		4096		// bytes mapped by a page
 #define PGSHIFT		12		// log2(PGSIZE)
 
 #define PTSIZE		(PGSIZE*NPTENTRIES) // bytes mapped by a page directory entry
+#ifdef PAE
+#define PTSHIFT		21		// log2(PTSIZE)
+#else
 #define PTSHIFT		22		// log2(PTSIZE)
+#endif
 
 #define PTXSHIFT	12		// offset of PTX in a linear address
-#define PDXSHIFT	22		// offset of PDX in a linear address
+#define PDXSHIFT	PTSHIFT		// offset of PDX in a linear address
+#define PDPXSHIFT	30		// offset of PDPX in a linear address (PAE)
 
 // Page table/directory entry flags.
 #define PTE_P		0x001	// Present
@@ -64,16 +98,27 @@
 #define PTE_D		0x040	// Dirty
 #define PTE_PS		0x080	// Page Size
 #define PTE_G		0x100	// Global
+#ifdef PAE
+#define PTE_NX		0x8000000000000000ULL	// No-execute, with EFER_NXE
+#endif
 
-// The PTE_AVAIL bits aren't used by the kernel or interpreted by the
-// hardware, so user processes are allowed to set them arbitrarily.
+// The PTE_AVAIL bits aren't interpreted by the hardware.  The kernel
+// uses PTE_COW to mark copy-on-write pages and page tables; user
+// processes are allowed to set the others arbitrarily.
 #define PTE_AVAIL	0xE00	// Available for software use
+#define PTE_COW		0x800	// Copy on write (kern/pmap.c)
 
 // Flags in PTE_SYSCALL may be used in system calls.  (Others may not.)
-#define PTE_SYSCALL	(PTE_AVAIL | PTE_P | PTE_W | PTE_U)
+#define PTE_SYSCALL	((PTE_AVAIL & ~PTE_COW) | PTE_P | PTE_W | PTE_U)
 
-// Address in page table or page directory entry
+// Address and flags in page table or page directory entry
+#ifdef PAE
+#define PTE_ADDR(pte)	((physaddr_t) (pte) & 0x000FFFFFFFFFF000ULL)
+#define PTE_FLAGS(pte)	((pte) & (PTE_NX | 0xFFF))
+#else
 #define PTE_ADDR(pte)	((physaddr_t) (pte) & ~0xFFF)
+#define PTE_FLAGS(pte)	((pte) & 0xFFF)
+#endif
 
 // Control Register flags
 #define CR0_PE		0x00000001	// Protection Enable
@@ -90,12 +135,17 @@
 
 #define CR4_PCE		0x00000100	// Performance counter enable
 #define CR4_MCE		0x00000040	// Machine Check Enable
+#define CR4_PAE		0x00000020	// Physical Address Extension
 #define CR4_PSE		0x00000010	// Page Size Extensions
 #define CR4_DE		0x00000008	// Debugging Extensions
 #define CR4_TSD		0x00000004	// Time Stamp Disable
 #define CR4_PVI		0x00000002	// Protected-Mode Virtual Interrupts
 #define CR4_VME		0x00000001	// V86 Mode Extensions
 
+// Extended Feature Enable Register (MSR_EFER)
+#define MSR_EFER	0xC0000080
+#define EFER_NXE	0x00000800	// No-Execute Enable
+
 // Eflags register
 #define FL_CF		0x00000001	// Carry Flag
 #define FL_PF		0x00000004	// Parity Flag
@@ -223,7 +273,7 @@ struct Taskstate {
 	uintptr_t ts_esp2;
 	uint16_t ts_ss2;
 	uint16_t ts_padding3;
-	physaddr_t ts_cr3;	// Page directory base
+	uint32_t ts_cr3;	// Page directory base
 	uintptr_t ts_eip;	// Saved state from last task switch
 	uint32_t ts_eflags;
 	uint32_t ts_eax;	// More saved state (registers)
@@ -0,0 +1,58 @@
+#ifndef JOS_INC_MULTIBOOT_H
+#define JOS_INC_MULTIBOOT_H
+
+// The parts of the Multiboot 0.6.96 specification that JOS uses:
+// the machine state handed to the kernel's entry point, and the
+// physical memory map.  Both GRUB (the jos-grub target) and our own
+// boot loader (boot/main.c) enter the kernel this way.
+
+// Header flag: ask the loader for memory information.
+#define MULTIBOOT_MEMORY_INFO		0x00000002
+
+// %eax on entry to the kernel from a multiboot loader
+#define MULTIBOOT_BOOTLOADER_MAGIC	0x2BADB002
+
+// multiboot_info.flags
+#define MULTIBOOT_INFO_MEMORY		0x00000001	// mem_lower/upper valid
+#define MULTIBOOT_INFO_MEM_MAP		0x00000040	// mmap_* valid
+
+// multiboot_mmap_entry.type
+#define MULTIBOOT_MEMORY_AVAILABLE	1
+
+// Where boot/boot.S leaves the BIOS E820 map and boot/main.c builds
+// the multiboot_info that points at it.
+#define BOOT_MBINFO			0x6000
+#define BOOT_MBINFO_MMAP_LENGTH		(BOOT_MBINFO + 44)
+#define BOOT_MBINFO_MMAP_ADDR		(BOOT_MBINFO + 48)
+#define BOOT_MMAP			(BOOT_MBINFO + 0x40)
+#define BOOT_MMAP_MAX			32	// entries
+
+#ifndef __ASSEMBLER__
+
+#include <inc/types.h>
+
+struct multiboot_info {
+	uint32_t flags;
+	uint32_t mem_lower;		// KB below 1MB
+	uint32_t mem_upper;		// KB from 1MB to the first hole
+	uint32_t boot_device;
+	uint32_t cmdline;
+	uint32_t mods_count;
+	uint32_t mods_addr;
+	uint32_t syms[4];
+	uint32_t mmap_length;		// bytes
+	uint32_t mmap_addr;		// physical address
+};
+
+// 'size' is the size of the rest of the entry; the next entry starts
+// size + 4 bytes after this one.
+struct multiboot_mmap_entry {
+	uint32_t size;
+	uint64_t addr;
+	uint64_t len;
+	uint32_t type;
+} __attribute__((packed));
+
+#endif /* !__ASSEMBLER__ */
+
+#endif /* !JOS_INC_MULTIBOOT_H */
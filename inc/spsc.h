@@ -0,0 +1,91 @@
+#ifndef JOS_INC_SPSC_H
+#define JOS_INC_SPSC_H
+
+// Lock-free single-producer, single-consumer ring of 32-bit messages,
+// laid out to fit in one shared page: two index lines and 2KB of slots,
+// with the rest of the page free.
+//
+// Two environments that share a page (for example one passed with
+// ipc_send, as user/sendpage.c does) can exchange messages through it
+// without entering the kernel: one only ever calls spsc_send, the
+// other only ever calls spsc_recv.  A pair of rings, one page each,
+// makes a bidirectional channel.  Only when a ring is empty or full
+// does a side need the kernel, to wait for the other.
+//
+// The producer owns r_head and the consumer r_tail, each on its own
+// cache line next to that side's cached copy of the other index, so
+// the line holding an index only moves between CPUs when the cached
+// copy runs out.  x86 keeps stores in order with other stores and
+// loads in order with other loads, so a compiler barrier is enough to
+// publish a slot before the index that covers it.
+
+#include <inc/types.h>
+#include <inc/mmu.h>
+#include <inc/cache.h>
+#include <inc/assert.h>
+
+#define SPSC_SLOTS	512	// power of two; the whole ring fits a page
+
+struct SpscRing {
+	// Producer's line
+	volatile uint32_t r_head;	// slots written, ever
+	uint32_t r_tail_seen;		// producer's last read of r_tail
+	char r_pad0[CACHELINE - 2 * sizeof(uint32_t)];
+
+	// Consumer's line
+	volatile uint32_t r_tail;	// slots read, ever
+	uint32_t r_head_seen;		// consumer's last read of r_head
+	char r_pad1[CACHELINE - 2 * sizeof(uint32_t)];
+
+	uint32_t r_slots[SPSC_SLOTS];
+} ____cacheline_aligned;
+
+#define spsc_barrier()	asm volatile("" : : : "memory")
+
+// Initialize an empty ring in 'r', normally the shared page itself.
+// Call before the other side starts using it.
+static inline void
+spsc_init(struct SpscRing *r)
+{
+	static_assert(sizeof(struct SpscRing) <= PGSIZE);
+	r->r_head = r->r_tail_seen = 0;
+	r->r_tail = r->r_head_seen = 0;
+}
+
+// Producer: append 'msg'.  Returns 0 if the ring is full.
+static inline bool
+spsc_send(struct SpscRing *r, uint32_t msg)
+{
+	uint32_t head = r->r_head;
+
+	if (head - r->r_tail_seen == SPSC_SLOTS) {
+		r->r_tail_seen = r->r_tail;
+		if (head - r->r_tail_seen == SPSC_SLOTS)
+			return 0;
+	}
+	r->r_slots[head & (SPSC_SLOTS - 1)] = msg;
+	spsc_barrier();
+	r->r_head = head + 1;
+	return 1;
+}
+
+// Consumer: take the oldest message into '*msg'.  Returns 0 if the
+// ring is empty.
+static inline bool
+spsc_recv(struct SpscRing *r, uint32_t *msg)
+{
+	uint32_t tail = r->r_tail;
+
+	if (tail == r->r_head_seen) {
+		r->r_head_seen = r->r_head;
+		if (tail == r->r_head_seen)
+			return 0;
+	}
+	spsc_barrier();
+	*msg = r->r_slots[tail & (SPSC_SLOTS - 1)];
+	spsc_barrier();
+	r->r_tail = tail + 1;
+	return 1;
+}
+
+#endif	/* !JOS_INC_SPSC_H */
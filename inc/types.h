@@ -19,13 +19,18 @@ typedef unsigned int uint32_t;
 typedef long long int64_t;
 typedef unsigned long long uint64_t;
 
-// Pointers and addresses are 32 bits long.
+// Pointers and addresses are 32 bits long, except for physical
+// addresses in a PAE kernel, which reach past 4GB.
 // We use pointer types to represent virtual addresses,
 // uintptr_t to represent the numerical values of virtual addresses,
 // and physaddr_t to represent physical addresses.
 typedef int32_t intptr_t;
 typedef uint32_t uintptr_t;
+#ifdef PAE
+typedef uint64_t physaddr_t;
+#else
 typedef uint32_t physaddr_t;
+#endif
 
 // Page numbers are 32 bits long.
 typedef uint32_t ppn_t;
@@ -248,6 +248,28 @@ read_tsc(void)
 	return tsc;
 }
 
+static inline uint64_t
+rdmsr(uint32_t msr)
+{
+	uint64_t val;
+	asm volatile("rdmsr" : "=A" (val) : "c" (msr));
+	return val;
+}
+
+static inline void
+wrmsr(uint32_t msr, uint64_t val)
+{
+	asm volatile("wrmsr" : : "c" (msr), "A" (val));
+}
+
+static inline uint64_t
+rdpmc(uint32_t counter)
+{
+	uint64_t val;
+	asm volatile("rdpmc" : "=A" (val) : "c" (counter));
+	return val;
+}
+
 static inline uint32_t
 xchg(volatile uint32_t *addr, uint32_t newval)
 {
@@ -0,0 +1,359 @@
+// In-kernel microbenchmarks for primitive operations.
+//
+// Each benchmark is timed BENCH_TRIALS times with read_tsc() between
+// serializing cpuid instructions, so earlier instructions cannot drift
+// into or out of the timed region.  The cost of an empty timed region
+// is measured first and subtracted from every result.
+
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/x86.h>
+#include <inc/spsc.h>
+
+#include <kern/bench.h>
+#include <kern/console.h>
+#include <kern/monitor.h>
+#include <kern/kdebug.h>
+#include <kern/pmap.h>
+#include <kern/slab.h>
+#include <kern/kmalloc.h>
+
+static uint8_t bench_src[4096], bench_dst[4096];
+static char bench_line[128];
+static struct KmemCache *bench_cache;
+static pde_t *bench_pgdir;
+static struct SpscRing bench_ring;
+
+static void
+bench_null(void)
+{
+}
+
+static void
+bench_memcpy_64(void)
+{
+	memcpy(bench_dst, bench_src, 64);
+}
+
+static void
+bench_memcpy_1k(void)
+{
+	memcpy(bench_dst, bench_src, 1024);
+}
+
+static void
+bench_memcpy_4k(void)
+{
+	memcpy(bench_dst, bench_src, 4096);
+}
+
+static void
+bench_memset_64(void)
+{
+	memset(bench_dst, 0, 64);
+}
+
+static void
+bench_memset_1k(void)
+{
+	memset(bench_dst, 0, 1024);
+}
+
+static void
+bench_memset_4k(void)
+{
+	memset(bench_dst, 0, 4096);
+}
+
+// A formatted line all the way to the console.  The line is plain
+// filler, so it can't be taken for a result or a kernel message.
+static void
+bench_cprintf(void)
+{
+	cprintf("cprintf %s %d %08x\n", "line", 42, 0xf0100000);
+}
+
+static int
+bench_format(const char *fmt, ...)
+{
+	va_list ap;
+	int r;
+
+	va_start(ap, fmt);
+	r = vsnprintf(bench_line, sizeof(bench_line), fmt, ap);
+	va_end(ap);
+	return r;
+}
+
+static void
+bench_vsnprintf(void)
+{
+	bench_format("\t %s:%d: %.*s+%d\n", "kern/init.c", 24, 14,
+		     "test_backtrace:F(0,25)", 21);
+}
+
+static void
+bench_cga_scroll(void)
+{
+	cga_scroll();
+}
+
+static void
+bench_serial_putc(void)
+{
+	serial_putc(0);
+}
+
+static void
+bench_debuginfo_eip(void)
+{
+	struct Eipdebuginfo info;
+
+	debuginfo_eip((uintptr_t) bench_debuginfo_eip, &info);
+}
+
+static void
+bench_parse_cmd(void)
+{
+	char *argv[MAXARGS];
+
+	strcpy(bench_line, "perf start -g 1000");
+	parse_cmd(bench_line, argv);
+}
+
+// One page allocated and freed: a per-CPU page cache hit.
+static void
+bench_page_alloc(void)
+{
+	page_free(page_alloc(0));
+}
+
+// 64 pages allocated, then freed, so the page cache refills from and
+// drains to the buddy lists in batches.
+static void
+bench_page_alloc_64(void)
+{
+	struct PageInfo *pp[64];
+	int i;
+
+	for (i = 0; i < 64; i++)
+		pp[i] = page_alloc(0);
+	for (i = 0; i < 64; i++)
+		if (pp[i])
+			page_free(pp[i]);
+}
+
+// A two-page block, which always goes to the buddy lists.
+static void
+bench_page_alloc_order1(void)
+{
+	struct PageInfo *pp = page_alloc_order(1, 0);
+
+	if (pp)
+		page_free(pp);
+}
+
+// One 64-byte object allocated and freed: a per-CPU free stack hit.
+static void
+bench_slab_alloc(void)
+{
+	if (!bench_cache)
+		bench_cache = kmem_cache_create("bench", 64, 0, NULL);
+	kmem_cache_free(bench_cache, kmem_cache_alloc(bench_cache));
+}
+
+static void
+bench_kmalloc_100(void)
+{
+	kfree(kmalloc(100));
+}
+
+static void
+bench_kmalloc_8k(void)
+{
+	kfree(kmalloc(8192));
+}
+
+// A parent address space with one page table of pages (PTSIZE),
+// built on first use and kept.
+static pde_t *
+bench_parent(void)
+{
+	struct PageInfo *pp;
+	uintptr_t va;
+
+	if (bench_pgdir || !(bench_pgdir = pgdir_create()))
+		return bench_pgdir;
+	for (va = UTEXT; va < UTEXT + PTSIZE; va += PGSIZE) {
+		if (!(pp = page_alloc(ALLOC_HIGH | ALLOC_ZERO)))
+			break;
+		if (page_insert(bench_pgdir, pp, (void *) va,
+				PTE_P | PTE_W | PTE_U) < 0) {
+			page_free(pp);
+			break;
+		}
+	}
+	return bench_pgdir;
+}
+
+// Copy-on-write fork of the parent, then the child exits.
+static void
+bench_fork_exit(void)
+{
+	pde_t *child = pgdir_create();
+
+	if (!child)
+		return;
+	pgdir_fork(child, bench_parent());
+	pgdir_destroy(child);
+}
+
+// The same, but the child writes one page before exiting, which
+// copies its page table and that page.
+static void
+bench_fork_write_exit(void)
+{
+	pde_t *child = pgdir_create();
+
+	if (!child)
+		return;
+	pgdir_fork(child, bench_parent());
+	pgdir_load(child);
+	*(volatile uint32_t *) UTEXT = 1;
+	pgdir_load(kern_pgdir);
+	pgdir_destroy(child);
+}
+
+// The parent's pages mapped into a new address space page by page, as
+// one sys_page_map per page would...
+static void
+bench_map_pages(void)
+{
+	pde_t *parent = bench_parent(), *pgdir = pgdir_create();
+	struct PageInfo *pp;
+	uintptr_t va;
+
+	if (!pgdir)
+		return;
+	for (va = UTEXT; va < UTEXT + PTSIZE; va += PGSIZE)
+		if ((pp = page_lookup(parent, (void *) va, NULL)))
+			page_insert(pgdir, pp, (void *) va, PTE_P | PTE_U);
+	pgdir_destroy(pgdir);
+}
+
+// ...and as one batch.
+static void
+bench_map_batch(void)
+{
+	struct PageMapRange r = {
+		UTEXT, UTEXT, PTSIZE / PGSIZE, PTE_P | PTE_U, 0
+	};
+	pde_t *parent = bench_parent(), *pgdir = pgdir_create();
+
+	if (!pgdir)
+		return;
+	page_map_batch(pgdir, parent, &r, 1);
+	pgdir_destroy(pgdir);
+}
+
+// 64 messages through a shared-memory ring and back out: the cost
+// per message without the cross-CPU cache traffic of two sides.
+static void
+bench_spsc_64(void)
+{
+	uint32_t i, msg;
+
+	for (i = 0; i < 64; i++)
+		spsc_send(&bench_ring, i);
+	for (i = 0; i < 64; i++)
+		spsc_recv(&bench_ring, &msg);
+}
+
+static struct Benchmark benchmarks[] = {
+	{ "memcpy_64", bench_memcpy_64 },
+	{ "memcpy_1k", bench_memcpy_1k },
+	{ "memcpy_4k", bench_memcpy_4k },
+	{ "memset_64", bench_memset_64 },
+	{ "memset_1k", bench_memset_1k },
+	{ "memset_4k", bench_memset_4k },
+	{ "cprintf", bench_cprintf },
+	{ "vsnprintf", bench_vsnprintf },
+	{ "cga_scroll", bench_cga_scroll },
+	{ "serial_putc", bench_serial_putc },
+	{ "debuginfo_eip", bench_debuginfo_eip },
+	{ "parse_cmd", bench_parse_cmd },
+	{ "page_alloc", bench_page_alloc },
+	{ "page_alloc_64", bench_page_alloc_64 },
+	{ "page_alloc_order1", bench_page_alloc_order1 },
+	{ "slab_alloc", bench_slab_alloc },
+	{ "kmalloc_100", bench_kmalloc_100 },
+	{ "kmalloc_8k", bench_kmalloc_8k },
+	{ "fork_exit", bench_fork_exit },
+	{ "fork_write_exit", bench_fork_write_exit },
+	{ "map_pages", bench_map_pages },
+	{ "map_batch", bench_map_batch },
+	{ "spsc_64", bench_spsc_64 },
+};
+
+// Time one call of 'func' in cycles.
+static uint64_t
+bench_time(void (*func)(void))
+{
+	uint64_t start, end;
+
+	cpuid(0, NULL, NULL, NULL, NULL);
+	start = read_tsc();
+	func();
+	cpuid(0, NULL, NULL, NULL, NULL);
+	end = read_tsc();
+	return end - start;
+}
+
+// Run 'func' BENCH_TRIALS times, leaving the sorted timings in 't'.
+static void
+bench_trials(void (*func)(void), uint64_t *t)
+{
+	uint64_t x;
+	int i, j;
+
+	func();		// warm caches and TLB
+	for (i = 0; i < BENCH_TRIALS; i++) {
+		x = bench_time(func);
+		for (j = i; j > 0 && t[j-1] > x; j--)
+			t[j] = t[j-1];
+		t[j] = x;
+	}
+}
+
+int
+bench_run(const char *prefix)
+{
+	uint64_t t[BENCH_TRIALS], overhead;
+	int i, j, n = 0;
+
+	bench_trials(bench_null, t);
+	overhead = t[0];
+
+	for (i = 0; i < ARRAY_SIZE(benchmarks); i++) {
+		if (prefix && strncmp(benchmarks[i].name, prefix,
+				      strlen(prefix)) != 0)
+			continue;
+		bench_trials(benchmarks[i].func, t);
+		for (j = 0; j < BENCH_TRIALS; j++)
+			t[j] = t[j] > overhead ? t[j] - overhead : 0;
+		cprintf("bench %s min %llu median %llu max %llu\n",
+			benchmarks[i].name, t[0], t[BENCH_TRIALS / 2],
+			t[BENCH_TRIALS - 1]);
+		n++;
+	}
+	return n;
+}
+
+void
+bench_list(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(benchmarks); i++)
+		cprintf("%s\n", benchmarks[i].name);
+}
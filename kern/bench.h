@@ -0,0 +1,22 @@
+#ifndef JOS_KERN_BENCH_H
+#define JOS_KERN_BENCH_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+#define BENCH_TRIALS	31	// timed runs per benchmark (odd, for the median)
+
+struct Benchmark {
+	const char *name;
+	void (*func)(void);	// one timed iteration
+};
+
+// Run every benchmark whose name starts with 'prefix' (all if NULL),
+// printing one "bench <name> min <c> median <c> max <c>" line each.
+// Returns the number of benchmarks run.
+int bench_run(const char *prefix);
+void bench_list(void);
+
+#endif	// !JOS_KERN_BENCH_H
@@ -5,8 +5,11 @@
 #include <inc/kbdreg.h>
 #include <inc/string.h>
 #include <inc/assert.h>
+#include <inc/cache.h>
 
 #include <kern/console.h>
+#include <kern/trace.h>
+#include <kern/pmap.h>
 
 static void cons_intr(int (*proc)(void));
 static void cons_putc(int c);
@@ -45,7 +48,7 @@ delay(void)
 #define   COM_LSR_TXRDY	0x20	//   Transmit buffer avail
 #define   COM_LSR_TSRE	0x40	//   Transmitter off
 
-static bool serial_exists;
+static bool serial_exists __read_mostly;
 
 static int
 serial_proc_data(void)
@@ -62,7 +65,7 @@ serial_intr(void)
 		cons_intr(serial_proc_data);
 }
 
-static void
+void
 serial_putc(int c)
 {
 	int i;
@@ -125,9 +128,9 @@ lpt_putc(int c)
 
 /***** Text-mode CGA/VGA display output *****/
 
-static unsigned addr_6845;
-static uint16_t *crt_buf;
-static uint16_t crt_pos;
+static unsigned addr_6845 __read_mostly;
+static uint16_t *crt_buf __read_mostly;
+static uint16_t crt_pos __cacheline_aligned;
 static uint16_t crt_color;
 static uint8_t escape_read;
 static int escape_code_buffer;
@@ -182,6 +185,19 @@ cga_apply_escape_code(void)
 	}
 }
 
+// Move the screen contents up one line and blank the last line.
+void
+cga_scroll(void)
+{
+	int i;
+
+	memmove(crt_buf, crt_buf + CRT_COLS, (CRT_SIZE - CRT_COLS) * sizeof(uint16_t));
+	for (i = CRT_SIZE - CRT_COLS; i < CRT_SIZE; i++)
+		crt_buf[i] = crt_color | ' ';
+	if (crt_pos >= CRT_COLS)
+		crt_pos -= CRT_COLS;
+}
+
 static void
 cga_putc(int c)
 {
@@ -256,14 +272,8 @@ cga_putc(int c)
 	}
 
 	// move terminal output up when a new line is needed
-	if (crt_pos >= CRT_SIZE) {
-		int i;
-
-		memmove(crt_buf, crt_buf + CRT_COLS, (CRT_SIZE - CRT_COLS) * sizeof(uint16_t));
-		for (i = CRT_SIZE - CRT_COLS; i < CRT_SIZE; i++)
-			crt_buf[i] = crt_color | ' ';
-		crt_pos -= CRT_COLS;
-	}
+	if (crt_pos >= CRT_SIZE)
+		cga_scroll();
 
 	/* move that little blinky thing */
 	outb(addr_6845, 14);
@@ -287,7 +297,7 @@ cga_putc(int c)
 
 #define E0ESC		(1<<6)
 
-static uint8_t shiftcode[256] =
+static uint8_t shiftcode[256] __read_mostly =
 {
 	[0x1D] = CTL,
 	[0x2A] = SHIFT,
@@ -297,14 +307,14 @@ static uint8_t shiftcode[256] =
 	[0xB8] = ALT
 };
 
-static uint8_t togglecode[256] =
+static uint8_t togglecode[256] __read_mostly =
 {
 	[0x3A] = CAPSLOCK,
 	[0x45] = NUMLOCK,
 	[0x46] = SCROLLLOCK
 };
 
-static uint8_t normalmap[256] =
+static uint8_t normalmap[256] __read_mostly =
 {
 	NO,   0x1B, '1',  '2',  '3',  '4',  '5',  '6',	// 0x00
 	'7',  '8',  '9',  '0',  '-',  '=',  '\b', '\t',
@@ -325,7 +335,7 @@ static uint8_t normalmap[256] =
 	[0xD2] = KEY_INS,	      [0xD3] = KEY_DEL
 };
 
-static uint8_t shiftmap[256] =
+static uint8_t shiftmap[256] __read_mostly =
 {
 	NO,   033,  '!',  '@',  '#',  '$',  '%',  '^',	// 0x00
 	'&',  '*',  '(',  ')',  '_',  '+',  '\b', '\t',
@@ -348,7 +358,7 @@ static uint8_t shiftmap[256] =
 
 #define C(x) (x - '@')
 
-static uint8_t ctlmap[256] =
+static uint8_t ctlmap[256] __read_mostly =
 {
 	NO,      NO,      NO,      NO,      NO,      NO,      NO,      NO,
 	NO,      NO,      NO,      NO,      NO,      NO,      NO,      NO,
@@ -365,7 +375,7 @@ static uint8_t ctlmap[256] =
 	[0xD2] = KEY_INS,		[0xD3] = KEY_DEL
 };
 
-static uint8_t *charcode[4] = {
+static uint8_t *charcode[4] __read_mostly = {
 	normalmap,
 	shiftmap,
 	ctlmap,
@@ -452,7 +462,7 @@ static struct {
 	uint8_t buf[CONSBUFSIZE];
 	uint32_t rpos;
 	uint32_t wpos;
-} cons;
+} cons __cacheline_aligned;
 
 // called by device interrupt routines to feed input characters
 // into the circular console input buffer.
@@ -464,6 +474,7 @@ cons_intr(int (*proc)(void))
 	while ((c = (*proc)()) != -1) {
 		if (c == 0)
 			continue;
+		TRACE_EVENT("cons_intr", c, cons.wpos);
 		cons.buf[cons.wpos++] = c;
 		if (cons.wpos == CONSBUFSIZE)
 			cons.wpos = 0;
@@ -527,8 +538,9 @@ getchar(void)
 {
 	int c;
 
+	// Waiting for input is the kernel's idle time.
 	while ((c = cons_getc()) == 0)
-		/* do nothing */;
+		page_zero_idle();
 	return c;
 }
 
@@ -23,4 +23,8 @@ int cons_getc(void);
 void kbd_intr(void); // irq 1
 void serial_intr(void); // irq 4
 
+// Raw device output, bypassing the other console devices.
+void serial_putc(int c);
+void cga_scroll(void);
+
 #endif /* _CONSOLE_H_ */
@@ -0,0 +1,18 @@
+#ifndef JOS_KERN_CPU_H
+#define JOS_KERN_CPU_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+// Maximum number of CPUs.  Per-CPU state is sized by this.  We do not
+// bring up the application processors yet, so only CPU 0 ever runs.
+#define NCPU	1
+
+// The index of the CPU we are running on.
+static inline int
+cpunum(void)
+{
+	return 0;
+}
+
+#endif
@@ -1,6 +1,27 @@
 #include <inc/mmu.h>
 #include <inc/memlayout.h>
 
+#ifdef PAE
+
+// With PAE, 2MB pages need no page table and no CPU feature check, so
+// the entry.S page directory maps [KERNBASE, KERNBASE+2MB) and [0, 2MB)
+// to physical [0, 2MB) with one large page each.  That is PTSIZE, as in
+// the two-level build, and holds the kernel and its first boot_alloc
+// pages.  The page directory pointer table that selects the four page
+// directories is entry_pdpt, in entry.S: a C initializer can't put an
+// address in a 64-bit entry.
+__attribute__((__aligned__(PGSIZE)))
+pde_t entry_pgdir[NPDENTRIES] = {
+	// Map VA's [0, 2MB) to PA's [0, 2MB)
+	[0]
+		= 0x000000 | PTE_PS | PTE_P,
+	// Map VA's [KERNBASE, KERNBASE+2MB) to PA's [0, 2MB)
+	[KERNBASE>>PDXSHIFT]
+		= 0x000000 | PTE_PS | PTE_P | PTE_W
+};
+
+#else
+
 pte_t entry_pgtable[NPTENTRIES];
 
 // The entry.S page directory maps the first 4MB of physical memory
@@ -1057,3 +1078,4 @@ pte_t entry_pgtable[NPTENTRIES] = {
 	0x3ff000 | PTE_P | PTE_W,
 };
 
+#endif
@@ -0,0 +1,301 @@
+// Hardware characterization benchmarks.
+//
+// These run on a scratch window of large-page blocks (4MB, or 2MB with
+// PAE) from the page allocator, mapped contiguously in the otherwise
+// empty user half of kern_pgdir while a benchmark runs.  Latency and
+// bandwidth runs map it with large pages so TLB misses do not pollute
+// the cache numbers; the TLB probe and the random-update run map the
+// same memory first with 4KB and then with large pages and compare
+// the two.
+//
+// Every result line starts with "hwbench" so it can be scraped from
+// the serial log.
+
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/memlayout.h>
+#include <inc/x86.h>
+
+#include <kern/hwbench.h>
+#include <kern/pmap.h>
+
+#define HWB_BASE	UTEXT			// scratch window VA
+#define HWB_ORDER	(PTSHIFT - PGSHIFT)	// one block per large page
+#define HWB_MAXPDE	((32 << 20) / PTSIZE)	// largest window: 32MB
+#define HWB_TLBPT	((8 << 20) / PTSIZE)	// 4KB-mapped TLB window: 8MB
+#define HWB_LINE	64			// assumed cache line size
+#define HWB_LOADS	(1 << 20)		// dependent loads per latency run
+#define HWB_UPDATES	(1 << 20)		// updates per random-update run
+
+// The large page size, as it appears in the output
+#ifdef PAE
+#define HWB_LARGE	"2MB"
+#define HWB_LARGE_TAG	"2m"
+#else
+#define HWB_LARGE	"4MB"
+#define HWB_LARGE_TAG	"4m"
+#endif
+
+static pte_t hwb_pgtable[HWB_MAXPDE][NPTENTRIES]
+	__attribute__((__aligned__(PGSIZE)));
+
+static struct PageInfo *hwb_blocks[HWB_MAXPDE];
+static volatile uintptr_t hwb_sink;
+static uint32_t hwb_seed = 2463534242U;
+
+static uint32_t
+hwb_rand(void)
+{
+	// xorshift32
+	hwb_seed ^= hwb_seed << 13;
+	hwb_seed ^= hwb_seed >> 17;
+	hwb_seed ^= hwb_seed << 5;
+	return hwb_seed;
+}
+
+// Allocate up to 'max' large-page blocks for the window; returns how
+// many were available.  Buddy blocks are naturally aligned, so each
+// one can be mapped with a single large page.  The window is
+// the only mapping they need, so they may come from highmem.
+static int
+hwb_alloc(int max)
+{
+	int n;
+
+	for (n = 0; n < MIN(max, HWB_MAXPDE); n++)
+		if (!(hwb_blocks[n] = page_alloc_order(HWB_ORDER,
+						       ALLOC_HIGH)))
+			break;
+	return n;
+}
+
+// Map the first 'npde' window blocks at HWB_BASE, with large pages if
+// 'large', else with 4KB pages from hwb_pgtable.
+static void
+hwb_map(int npde, bool large)
+{
+	physaddr_t pa;
+	int i, j;
+
+	if (large)
+		lcr4(rcr4() | CR4_PSE);
+	for (i = 0; i < npde; i++) {
+		pa = page2pa(hwb_blocks[i]);
+		if (large) {
+			kern_pgdir[PDX(HWB_BASE) + i] =
+				pa | PTE_PS | PTE_W | PTE_P;
+			continue;
+		}
+		for (j = 0; j < NPTENTRIES; j++)
+			hwb_pgtable[i][j] = (pa + j * PGSIZE) | PTE_W | PTE_P;
+		kern_pgdir[PDX(HWB_BASE) + i] =
+			PADDR(hwb_pgtable[i]) | PTE_W | PTE_P;
+	}
+	tlbflush();
+}
+
+// Unmap the window and give its blocks back.
+static void
+hwb_unmap(int npde)
+{
+	int i;
+
+	for (i = 0; i < npde; i++) {
+		kern_pgdir[PDX(HWB_BASE) + i] = 0;
+		page_free(hwb_blocks[i]);
+	}
+	tlbflush();
+}
+
+// Link 'n' nodes into one random cycle (Sattolo's algorithm), node i
+// living at base + i*stride + i*skew % stride.  Returns the first node.
+static void **
+hwb_chain(char *base, uint32_t n, uint32_t stride, uint32_t skew)
+{
+	uint32_t i, j, t;
+
+#define NODE(i)	((void **) (base + (i) * stride + (i) * skew % stride))
+	for (i = 0; i < n; i++)
+		*(uint32_t *) NODE(i) = i;
+	for (i = n - 1; i > 0; i--) {
+		j = hwb_rand() % i;
+		t = *(uint32_t *) NODE(i);
+		*(uint32_t *) NODE(i) = *(uint32_t *) NODE(j);
+		*(uint32_t *) NODE(j) = t;
+	}
+	for (i = 0; i < n; i++)
+		*NODE(i) = NODE(*(uint32_t *) NODE(i));
+	return NODE(0);
+#undef NODE
+}
+
+// Follow the chain for 'loads' dependent loads; return cycles taken.
+static uint64_t
+hwb_chase(void **p, uint32_t loads)
+{
+	uint64_t start;
+
+	cpuid(0, NULL, NULL, NULL, NULL);
+	start = read_tsc();
+	while (loads--)
+		p = *p;
+	cpuid(0, NULL, NULL, NULL, NULL);
+	hwb_sink = (uintptr_t) p;
+	return read_tsc() - start;
+}
+
+// Print x/y with one decimal place.
+static void
+hwb_print_ratio(const char *what, uint32_t size, uint64_t x, uint64_t y)
+{
+	uint32_t r = x * 10 / y;
+
+	cprintf("hwbench %s size %u %u.%u\n", what, size, r / 10, r % 10);
+}
+
+// Load-to-use latency in cycles for working sets from 4KB up to the
+// scratch window size, by chasing a random cycle of cache lines.
+void
+hwbench_latency(void)
+{
+	int npde = hwb_alloc(HWB_MAXPDE);
+	uint32_t size;
+	void **p;
+
+	if (npde < 1) {
+		cprintf("hwbench: not enough memory\n");
+		return;
+	}
+	hwb_map(npde, 1);
+	cprintf("hwbench lat: working-set bytes, cycles per load\n");
+	for (size = 4096; size <= npde * PTSIZE; size *= 2) {
+		p = hwb_chain((char *) HWB_BASE, size / HWB_LINE, HWB_LINE, 0);
+		hwb_chase(p, size / HWB_LINE);		// warm up
+		hwb_print_ratio("lat", size, hwb_chase(p, HWB_LOADS),
+				HWB_LOADS);
+	}
+	hwb_unmap(npde);
+}
+
+// STREAM-style copy (a = b) and scale (a = 3 * b) bandwidth, reported
+// in bytes moved (read plus written) per cycle.
+void
+hwbench_bandwidth(void)
+{
+	int npde = hwb_alloc(HWB_MAXPDE);
+	uint32_t size, n, i, rep, reps;
+	uint32_t *a, *b;
+	uint64_t start, copy, scale;
+
+	if (npde < 1) {
+		cprintf("hwbench: not enough memory\n");
+		return;
+	}
+	hwb_map(npde, 1);
+	cprintf("hwbench bw: bytes per array, bytes per cycle\n");
+	for (size = 4096; size <= npde * PTSIZE / 2; size *= 2) {
+		a = (uint32_t *) HWB_BASE;
+		b = (uint32_t *) (HWB_BASE + size);
+		n = size / sizeof(uint32_t);
+		reps = MAX(1, (4 << 20) / size);
+		memset(b, 1, size);
+
+		cpuid(0, NULL, NULL, NULL, NULL);
+		start = read_tsc();
+		for (rep = 0; rep < reps; rep++)
+			for (i = 0; i < n; i++)
+				a[i] = b[i];
+		cpuid(0, NULL, NULL, NULL, NULL);
+		copy = read_tsc() - start;
+
+		cpuid(0, NULL, NULL, NULL, NULL);
+		start = read_tsc();
+		for (rep = 0; rep < reps; rep++)
+			for (i = 0; i < n; i++)
+				a[i] = 3 * b[i];
+		cpuid(0, NULL, NULL, NULL, NULL);
+		scale = read_tsc() - start;
+
+		hwb_print_ratio("copy", size, 2ULL * size * reps, copy);
+		hwb_print_ratio("scale", size, 2ULL * size * reps, scale);
+	}
+	hwb_unmap(npde);
+}
+
+// TLB reach: chase one cache line in each of 'n' pages, in random
+// order, first with 4KB mappings and then with one large page per
+// block.  The lines are skewed across cache sets so the touched data
+// stays cache-resident and the difference is address translation.
+void
+hwbench_tlb(void)
+{
+	int npde = hwb_alloc(HWB_TLBPT);
+	uint32_t n;
+	uint64_t small, large;
+	void **p;
+
+	if (npde < 1) {
+		cprintf("hwbench: not enough memory\n");
+		return;
+	}
+	cprintf("hwbench tlb: pages touched, cycles per load 4KB / "
+		HWB_LARGE "\n");
+	for (n = 8; n <= npde * NPTENTRIES; n *= 2) {
+		hwb_map(npde, 0);
+		p = hwb_chain((char *) HWB_BASE, n, PGSIZE, HWB_LINE);
+		hwb_chase(p, n);
+		small = hwb_chase(p, HWB_LOADS);
+		hwb_map(npde, 1);
+		hwb_chase(p, n);
+		large = hwb_chase(p, HWB_LOADS);
+		hwb_print_ratio("tlb4k", n, small, HWB_LOADS);
+		hwb_print_ratio("tlb" HWB_LARGE_TAG, n, large, HWB_LOADS);
+	}
+	hwb_unmap(npde);
+}
+
+// Random read-modify-write updates to one word per update across
+// working sets up to the whole window (GUPS-style), with 4KB and then
+// large-page mappings.  Unlike the TLB probe, the data does not fit in
+// the caches either, so this shows what large pages save a
+// memory-bound workload: each update's page walk on top of its cache
+// miss.
+static uint64_t
+hwb_update(uint32_t *a, uint32_t n)
+{
+	uint64_t start;
+	uint32_t i;
+
+	cpuid(0, NULL, NULL, NULL, NULL);
+	start = read_tsc();
+	for (i = 0; i < HWB_UPDATES; i++)
+		a[hwb_rand() & (n - 1)] ^= i;
+	cpuid(0, NULL, NULL, NULL, NULL);
+	return read_tsc() - start;
+}
+
+void
+hwbench_update(void)
+{
+	int npde = hwb_alloc(HWB_MAXPDE);
+	uint32_t size;
+	uint64_t small, large;
+
+	if (npde < 1) {
+		cprintf("hwbench: not enough memory\n");
+		return;
+	}
+	cprintf("hwbench upd: working-set bytes, cycles per update 4KB / "
+		HWB_LARGE "\n");
+	for (size = 1 << 20; size <= npde * PTSIZE; size *= 2) {
+		hwb_map(npde, 0);
+		hwb_update((uint32_t *) HWB_BASE, size / 4);	// warm up
+		small = hwb_update((uint32_t *) HWB_BASE, size / 4);
+		hwb_map(npde, 1);
+		hwb_update((uint32_t *) HWB_BASE, size / 4);
+		large = hwb_update((uint32_t *) HWB_BASE, size / 4);
+		hwb_print_ratio("upd4k", size, small, HWB_UPDATES);
+		hwb_print_ratio("upd" HWB_LARGE_TAG, size, large, HWB_UPDATES);
+	}
+	hwb_unmap(npde);
+}
@@ -0,0 +1,15 @@
+#ifndef JOS_KERN_HWBENCH_H
+#define JOS_KERN_HWBENCH_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+// Hardware characterization: cache/DRAM latency, memory bandwidth,
+// TLB reach with 4KB versus large pages (4MB, or 2MB with PAE), and
+// what large pages save random updates to memory.
+void hwbench_latency(void);
+void hwbench_bandwidth(void);
+void hwbench_tlb(void);
+void hwbench_update(void);
+
+#endif	// !JOS_KERN_HWBENCH_H
@@ -6,6 +6,14 @@
 
 #include <kern/monitor.h>
 #include <kern/console.h>
+#include <kern/trap.h>
+#include <kern/picirq.h>
+#include <kern/kclock.h>
+#include <kern/trace.h>
+#include <kern/pmc.h>
+#include <kern/pmap.h>
+#include <kern/slab.h>
+#include <kern/kmalloc.h>
 
 // Test the stack backtrace function (lab 1 only)
 void
@@ -28,13 +36,32 @@ i386_init(void)
 	// Clear the uninitialized global data (BSS) section of our program.
 	// This ensures that all static/global variables start out zero.
 	memset(edata, 0, end - edata);
+	TRACE_EVENT("boot_bss_cleared", 0, 0);
 
 	// Initialize the console.
 	// Can't call cprintf until after we do this!
 	cons_init();
+	TRACE_EVENT("boot_cons_init", 0, 0);
 
 	cprintf("6828 decimal is %o octal!\n", 6828);
 
+	// Calibrate the TSC so we can tell time.
+	tsc_init();
+	TRACE_EVENT("boot_tsc_init", (uint32_t) (tsc_freq / 1000), 0);
+	pmc_init();
+
+	// Lab 2 memory management initialization functions
+	mem_init();
+	TRACE_EVENT("boot_mem_init", npages, 0);
+	slab_init();
+	kmalloc_init();
+
+	// Interrupt setup.  Interrupts stay disabled until a
+	// subsystem (such as the profiler) asks for them.
+	trap_init();
+	pic_init();
+	TRACE_EVENT("boot_trap_init", 0, 0);
+
 	// Test the stack backtrace function (lab 1 only)
 	test_backtrace(5);
 
@@ -48,6 +75,7 @@ i386_init(void)
 	cprintf("[45m\n");
 	cprintf("[40;37m\n");
 	// Drop into the kernel monitor.
+	TRACE_EVENT("boot_monitor", 0, 0);
 	while (1)
 		monitor(NULL);
 }
@@ -71,6 +99,7 @@ _panic(const char *file, int line, const char *fmt,...)
 	if (panicstr)
 		goto dead;
 	panicstr = fmt;
+	TRACE_EVENT("panic", line, 0);
 
 	// Be extra sure that the machine is in as reasonable state
 	asm volatile("cli; cld");
@@ -0,0 +1,108 @@
+/* See COPYRIGHT for copyright information. */
+
+/* Support for reading the NVRAM from the real-time clock,
+ * for the 8253 programmable interval timer,
+ * and for the time stamp counter. */
+
+#include <inc/x86.h>
+#include <inc/trap.h>
+#include <inc/assert.h>
+#include <inc/stdio.h>
+#include <inc/cache.h>
+
+#include <kern/kclock.h>
+#include <kern/picirq.h>
+
+
+unsigned
+mc146818_read(unsigned reg)
+{
+	outb(IO_RTC, reg);
+	return inb(IO_RTC+1);
+}
+
+void
+mc146818_write(unsigned reg, unsigned datum)
+{
+	outb(IO_RTC, reg);
+	outb(IO_RTC+1, datum);
+}
+
+void
+kclock_start(int hz)
+{
+	assert(hz >= 19 && hz <= TIMER_FREQ);	// divisor must fit 16 bits
+
+	/* initialize 8253 clock to interrupt 'hz' times/sec */
+	outb(TIMER_MODE, TIMER_SEL0 | TIMER_RATEGEN | TIMER_16BIT);
+	outb(TIMER_CNTR0, TIMER_DIV(hz) % 256);
+	outb(TIMER_CNTR0, TIMER_DIV(hz) / 256);
+	irq_setmask_8259A(irq_mask_8259A & ~(1<<IRQ_TIMER));
+}
+
+void
+kclock_stop(void)
+{
+	irq_setmask_8259A(irq_mask_8259A | (1<<IRQ_TIMER));
+}
+
+
+/***** Time stamp counter *****/
+
+#define TSC_CALIBRATE_MS	50
+
+uint64_t tsc_freq __read_mostly;
+uint32_t tsc_mult __read_mostly;
+bool tsc_invariant __read_mostly;
+static uint64_t tsc_boot;
+
+// Count TSC ticks while PIT channel 2 counts down TSC_CALIBRATE_MS.
+static uint64_t
+tsc_calibrate(void)
+{
+	uint32_t latch = TIMER_FREQ / (1000 / TSC_CALIBRATE_MS);
+	uint64_t start, end;
+
+	// Gate channel 2 on, keep the speaker off.
+	outb(IO_PPI, (inb(IO_PPI) & ~PPI_SPKR) | PPI_GATE2);
+
+	// One-shot countdown; OUT2 goes high at terminal count.
+	outb(TIMER_MODE, TIMER_SEL2 | TIMER_16BIT | TIMER_INTTC);
+	outb(TIMER_CNTR2, latch & 0xFF);
+	outb(TIMER_CNTR2, latch >> 8);
+
+	start = read_tsc();
+	while (!(inb(IO_PPI) & PPI_OUT2))
+		/* do nothing */;
+	end = read_tsc();
+
+	return (end - start) * TIMER_FREQ / latch;
+}
+
+void
+tsc_init(void)
+{
+	uint32_t maxext, edx;
+
+	// CPUID.80000007H:EDX[8] advertises an invariant TSC.
+	cpuid(0x80000000, &maxext, NULL, NULL, NULL);
+	if (maxext >= 0x80000007) {
+		cpuid(0x80000007, NULL, NULL, NULL, &edx);
+		tsc_invariant = (edx >> 8) & 1;
+	}
+
+	tsc_freq = tsc_calibrate();
+	tsc_mult = (1000000000ULL << TSC_SHIFT) / tsc_freq;
+	tsc_boot = read_tsc();
+
+	cprintf("TSC: %u.%03u MHz%s\n", (uint32_t) (tsc_freq / 1000000),
+		(uint32_t) (tsc_freq / 1000 % 1000),
+		tsc_invariant ? ", invariant" : "");
+}
+
+// Nanoseconds since tsc_init().
+uint64_t
+clock_ns(void)
+{
+	return cycles_to_ns(read_tsc() - tsc_boot);
+}
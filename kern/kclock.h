@@ -0,0 +1,76 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_KCLOCK_H
+#define JOS_KERN_KCLOCK_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+#define	IO_RTC		0x070		/* RTC port */
+
+#define	MC_NVRAM_START	0xe	/* start of NVRAM: offset 14 */
+#define	MC_NVRAM_SIZE	50	/* 50 bytes of NVRAM */
+
+/* NVRAM bytes 7 & 8: base memory size */
+#define NVRAM_BASELO	(MC_NVRAM_START + 7)	/* low byte; RTC off. 0x15 */
+#define NVRAM_BASEHI	(MC_NVRAM_START + 8)	/* high byte; RTC off. 0x16 */
+
+/* NVRAM bytes 9 & 10: extended memory size (between 1MB and 16MB) */
+#define NVRAM_EXTLO	(MC_NVRAM_START + 9)	/* low byte; RTC off. 0x17 */
+#define NVRAM_EXTHI	(MC_NVRAM_START + 10)	/* high byte; RTC off. 0x18 */
+
+/* NVRAM bytes 38 and 39: extended memory size (between 16MB and 4G) */
+#define NVRAM_EXT16LO	(MC_NVRAM_START + 38)	/* low byte; RTC off. 0x34 */
+#define NVRAM_EXT16HI	(MC_NVRAM_START + 39)	/* high byte; RTC off. 0x35 */
+
+/* 8253/8254 programmable interval timer */
+#define	TIMER_FREQ	1193182
+#define	TIMER_DIV(x)	((TIMER_FREQ+(x)/2)/(x))
+
+#define	IO_TIMER1	0x040		/* 8253 Timer #1 */
+#define	TIMER_CNTR0	(IO_TIMER1 + 0)	/* timer 0 counter port */
+#define	TIMER_MODE	(IO_TIMER1 + 3)	/* timer mode port */
+#define	TIMER_SEL0	0x00	/* select counter 0 */
+#define	TIMER_RATEGEN	0x04	/* mode 2, rate generator */
+#define	TIMER_16BIT	0x30	/* r/w counter 16 bits, LSB first */
+#define	TIMER_CNTR2	(IO_TIMER1 + 2)	/* timer 2 counter port */
+#define	TIMER_SEL2	0x80	/* select counter 2 */
+#define	TIMER_INTTC	0x00	/* mode 0, intr on terminal cnt */
+
+/* Keyboard controller port B: gates PIT channel 2 and reads its output */
+#define	IO_PPI		0x061
+#define	PPI_GATE2	0x01	/* PIT channel 2 gate */
+#define	PPI_SPKR	0x02	/* speaker data enable */
+#define	PPI_OUT2	0x20	/* PIT channel 2 output (read-only) */
+
+unsigned mc146818_read(unsigned reg);
+void mc146818_write(unsigned reg, unsigned datum);
+
+// Start periodic timer interrupts (IRQ_TIMER) at 'hz' per second.
+void kclock_start(int hz);
+// Stop timer interrupts.
+void kclock_stop(void);
+
+// Time stamp counter.  tsc_init() measures the TSC frequency against
+// PIT channel 2; afterwards cycles_to_ns() converts with one multiply
+// and shift: ns = cycles * tsc_mult >> TSC_SHIFT.
+#define TSC_SHIFT	24
+
+extern uint64_t tsc_freq;	// TSC ticks per second
+extern uint32_t tsc_mult;	// (10^9 << TSC_SHIFT) / tsc_freq
+extern bool tsc_invariant;	// TSC rate is constant across P/C-states
+
+void tsc_init(void);
+uint64_t clock_ns(void);
+
+static inline uint64_t
+cycles_to_ns(uint64_t cycles)
+{
+	// Split the 64-bit count so neither product can overflow.
+	return (((cycles >> 32) * tsc_mult) << (32 - TSC_SHIFT))
+		+ (((cycles & 0xFFFFFFFF) * tsc_mult) >> TSC_SHIFT);
+}
+
+#endif	// !JOS_KERN_KCLOCK_H
@@ -2,6 +2,7 @@
 #include <inc/string.h>
 #include <inc/memlayout.h>
 #include <inc/assert.h>
+#include <inc/x86.h>
 
 #include <kern/kdebug.h>
 
@@ -10,6 +11,8 @@ extern const struct Stab __STAB_END__[];	// End of stabs table
 extern const char __STABSTR_BEGIN__[];		// Beginning of string table
 extern const char __STABSTR_END__[];		// End of string table
 
+extern char bootstack[], bootstacktop[];	// Kernel stack (entry.S)
+
 
 // stab_binsearch(stabs, region_left, region_right, type, addr)
 //
@@ -207,3 +210,63 @@ debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
 
 	return 0;
 }
+
+
+// capture_stack(buf, max)
+//
+//	Walk the EBP chain starting at our caller and record up to 'max'
+//	raw return EIPs into 'buf'.  Returns the number of EIPs recorded.
+//
+//	Unlike mon_backtrace(), this does no symbolization and no console
+//	output, so it is cheap enough to call from interrupt handlers and
+//	tracing hooks.  Every frame pointer is checked against the kernel
+//	stack bounds before it is dereferenced, so a corrupt chain ends the
+//	walk instead of faulting.  Use print_stack() to symbolize later.
+//
+int
+capture_stack(uintptr_t *buf, int max)
+{
+	return capture_stack_from(read_ebp(), buf, max);
+}
+
+// capture_stack_from(ebp, buf, max)
+//
+//	Like capture_stack(), but start from the frame pointer 'ebp',
+//	for example the one saved in an interrupted trap frame.
+//
+int
+capture_stack_from(uint32_t ebp, uintptr_t *buf, int max)
+{
+	uint32_t *base = (uint32_t *) ebp;
+	int n = 0;
+
+	while (n < max
+	       && (char *) base >= bootstack
+	       && (char *) (base + 2) <= bootstacktop) {
+		buf[n++] = base[1];
+		// Frames must move strictly up the stack.
+		if ((uint32_t *) base[0] <= base)
+			break;
+		base = (uint32_t *) base[0];
+	}
+	return n;
+}
+
+// print_stack(buf, n)
+//
+//	Symbolize and print 'n' EIPs previously recorded by capture_stack().
+//
+void
+print_stack(const uintptr_t *buf, int n)
+{
+	struct Eipdebuginfo info;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		debuginfo_eip(buf[i], &info);
+		cprintf("  [%d] %08x %s:%d: %.*s+%d\n", i, buf[i],
+			info.eip_file, info.eip_line,
+			info.eip_fn_namelen, info.eip_fn_name,
+			buf[i] - info.eip_fn_addr);
+	}
+}
@@ -17,4 +17,9 @@ struct Eipdebuginfo {
 
 int debuginfo_eip(uintptr_t eip, struct Eipdebuginfo *info);
 
+// Cheap stack capture: record raw return EIPs, symbolize later.
+int capture_stack(uintptr_t *buf, int max);
+int capture_stack_from(uint32_t ebp, uintptr_t *buf, int max);
+void print_stack(const uintptr_t *buf, int n);
+
 #endif
@@ -0,0 +1,287 @@
+// General-purpose kernel memory allocator.
+//
+// Small requests are rounded up to a size class and served from that
+// class's slab cache.  The classes between powers of two (96, 192)
+// keep the worst-case rounding waste near a third instead of a half.
+// Larger requests get a page-allocator block of the next power-of-two
+// number of pages.  kfree tells the two apart by whether the memory
+// belongs to a slab.
+//
+// Every class counts allocations, frees, live objects and the peak,
+// and bytes requested against bytes handed out.  With tracking on,
+// each live allocation is also recorded with its caller, so 'kmalloc
+// leaks' can list the call sites still holding memory.
+
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+
+#include <kern/kmalloc.h>
+#include <kern/slab.h>
+#include <kern/pmap.h>
+#include <kern/kdebug.h>
+
+struct KmallocClass {
+	size_t cl_size;			// 0 for page-allocator blocks
+	const char *cl_name;
+	struct KmemCache *cl_cache;
+	uint32_t cl_allocs;
+	uint32_t cl_frees;
+	uint32_t cl_live;
+	uint32_t cl_peak;
+	uint64_t cl_requested;		// bytes asked for, all allocations
+	uint64_t cl_granted;		// bytes handed out, all allocations
+};
+
+static struct KmallocClass kmalloc_classes[] = {
+	{ 16, "kmalloc-16" },
+	{ 32, "kmalloc-32" },
+	{ 64, "kmalloc-64" },
+	{ 96, "kmalloc-96" },
+	{ 128, "kmalloc-128" },
+	{ 192, "kmalloc-192" },
+	{ 256, "kmalloc-256" },
+	{ 512, "kmalloc-512" },
+	{ 1024, "kmalloc-1024" },
+	{ 2048, "kmalloc-2048" },
+	{ 0, "kmalloc-pages" },
+};
+
+#define KMALLOC_NCLASSES	ARRAY_SIZE(kmalloc_classes)
+#define KMALLOC_LARGE		(&kmalloc_classes[KMALLOC_NCLASSES - 1])
+
+// Size class for each 16-byte step up to KMALLOC_MAX_SMALL.
+static uint8_t kmalloc_index[KMALLOC_MAX_SMALL / 16];
+
+// Leak tracking: live allocations, hashed by address, each pointing
+// at the call site that made it.
+struct KmallocSite {
+	uintptr_t ks_eip;
+	uint32_t ks_live;
+	uint32_t ks_bytes;		// requested bytes still live
+};
+
+struct KmallocTrack {
+	void *kt_ptr;			// NULL if empty, KT_DELETED if freed
+	uint16_t kt_site;
+	uint32_t kt_size;
+};
+
+#define KT_DELETED	((void *) 1)
+
+bool kmalloc_tracking;
+static struct KmallocSite kmalloc_sites[KMALLOC_NSITES];
+static int kmalloc_nsites;
+static struct KmallocTrack kmalloc_tracked[KMALLOC_NTRACK];
+static uint32_t kmalloc_untracked;	// no free site or table slot
+
+void
+kmalloc_init(void)
+{
+	struct KmallocClass *cl;
+	int i, c = 0;
+
+	for (cl = kmalloc_classes; cl != KMALLOC_LARGE; cl++) {
+		// Align to the size's largest power-of-two factor, so no
+		// object spans more cache lines than its size requires.
+		cl->cl_cache = kmem_cache_create(cl->cl_name, cl->cl_size,
+			MIN(cl->cl_size & -cl->cl_size, CACHELINE), NULL);
+		if (!cl->cl_cache)
+			panic("kmalloc_init: out of memory");
+	}
+	for (i = 0; i < ARRAY_SIZE(kmalloc_index); i++) {
+		while (kmalloc_classes[c].cl_size < (i + 1) * 16)
+			c++;
+		kmalloc_index[i] = c;
+	}
+}
+
+static uint32_t
+kmalloc_hash(void *p)
+{
+	return ((uintptr_t) p >> 4) * 2654435761U >> 16;
+}
+
+static void
+kmalloc_track_alloc(void *p, size_t size, uintptr_t eip)
+{
+	struct KmallocTrack *kt;
+	uint32_t h = kmalloc_hash(p);
+	int s, i;
+
+	for (s = 0; s < kmalloc_nsites; s++)
+		if (kmalloc_sites[s].ks_eip == eip)
+			break;
+	if (s == kmalloc_nsites) {
+		if (s == KMALLOC_NSITES)
+			goto untracked;
+		kmalloc_sites[kmalloc_nsites++].ks_eip = eip;
+	}
+
+	for (i = 0; i < KMALLOC_NTRACK; i++) {
+		kt = &kmalloc_tracked[(h + i) & (KMALLOC_NTRACK - 1)];
+		if (kt->kt_ptr == NULL || kt->kt_ptr == KT_DELETED) {
+			kt->kt_ptr = p;
+			kt->kt_site = s;
+			kt->kt_size = size;
+			kmalloc_sites[s].ks_live++;
+			kmalloc_sites[s].ks_bytes += size;
+			return;
+		}
+	}
+untracked:
+	kmalloc_untracked++;
+}
+
+static void
+kmalloc_track_free(void *p)
+{
+	struct KmallocTrack *kt;
+	uint32_t h = kmalloc_hash(p);
+	int i;
+
+	for (i = 0; i < KMALLOC_NTRACK; i++) {
+		kt = &kmalloc_tracked[(h + i) & (KMALLOC_NTRACK - 1)];
+		if (kt->kt_ptr == NULL)
+			return;		// allocated before tracking began
+		if (kt->kt_ptr == p) {
+			kmalloc_sites[kt->kt_site].ks_live--;
+			kmalloc_sites[kt->kt_site].ks_bytes -= kt->kt_size;
+			kt->kt_ptr = KT_DELETED;
+			return;
+		}
+	}
+}
+
+//
+// Allocate 'size' bytes.  Returns NULL if size is 0 or memory is
+// exhausted.  Blocks of up to KMALLOC_MAX_SMALL bytes are aligned to
+// their size class's largest power-of-two factor, up to a cache line;
+// larger ones are page-aligned.
+//
+void *
+kmalloc(size_t size)
+{
+	struct KmallocClass *cl;
+	struct PageInfo *pp;
+	size_t granted;
+	int order = 0;
+	void *p;
+
+	if (size == 0)
+		return NULL;
+	if (size <= KMALLOC_MAX_SMALL) {
+		cl = &kmalloc_classes[kmalloc_index[(size - 1) / 16]];
+		if (!(p = kmem_cache_alloc(cl->cl_cache)))
+			return NULL;
+		granted = cl->cl_size;
+	} else {
+		cl = KMALLOC_LARGE;
+		while ((PGSIZE << order) < size)
+			if (++order > PAGE_MAX_ORDER)
+				return NULL;
+		if (!(pp = page_alloc_order(order, 0)))
+			return NULL;
+		p = page2kva(pp);
+		granted = PGSIZE << order;
+	}
+
+	cl->cl_allocs++;
+	cl->cl_live++;
+	cl->cl_peak = MAX(cl->cl_peak, cl->cl_live);
+	cl->cl_requested += size;
+	cl->cl_granted += granted;
+	if (kmalloc_tracking)
+		kmalloc_track_alloc(p, size,
+				    (uintptr_t) __builtin_return_address(0));
+	return p;
+}
+
+//
+// Free memory returned by kmalloc.  kfree(NULL) does nothing.
+//
+void
+kfree(void *p)
+{
+	struct KmallocClass *cl;
+	struct KmemCache *kc;
+
+	if (p == NULL)
+		return;
+	if ((kc = kmem_cache_of(p))) {
+		if (kc->kc_size > KMALLOC_MAX_SMALL)
+			panic("kfree: %p is from cache %s", p, kc->kc_name);
+		cl = &kmalloc_classes[kmalloc_index[(kc->kc_size - 1) / 16]];
+		if (cl->cl_cache != kc)
+			panic("kfree: %p is from cache %s", p, kc->kc_name);
+		kmem_cache_free(kc, p);
+	} else {
+		if (PGOFF(p))
+			panic("kfree: %p was not returned by kmalloc", p);
+		cl = KMALLOC_LARGE;
+		page_free(pa2page(PADDR(p)));
+	}
+
+	cl->cl_frees++;
+	cl->cl_live--;
+	if (kmalloc_tracking)
+		kmalloc_track_free(p);
+}
+
+//
+// Start leak tracking afresh, or stop it.
+//
+void
+kmalloc_track(bool on)
+{
+	if (on) {
+		memset(kmalloc_sites, 0, sizeof(kmalloc_sites));
+		memset(kmalloc_tracked, 0, sizeof(kmalloc_tracked));
+		kmalloc_nsites = 0;
+		kmalloc_untracked = 0;
+	}
+	kmalloc_tracking = on;
+}
+
+void
+kmalloc_stats(void)
+{
+	struct KmallocClass *cl;
+	uint64_t requested = 0, granted = 0;
+
+	cprintf("class           allocs    frees     live     peak\n");
+	for (cl = kmalloc_classes; cl < kmalloc_classes + KMALLOC_NCLASSES; cl++) {
+		cprintf("%-13s %8u %8u %8u %8u\n", cl->cl_name, cl->cl_allocs,
+			cl->cl_frees, cl->cl_live, cl->cl_peak);
+		requested += cl->cl_requested;
+		granted += cl->cl_granted;
+	}
+	cprintf("%llu bytes requested, %llu handed out (%llu%% rounding)\n",
+		requested, granted,
+		granted ? (granted - requested) * 100 / granted : 0);
+}
+
+//
+// List the call sites with tracked allocations that are still live.
+//
+void
+kmalloc_leaks(void)
+{
+	struct KmallocSite *ks;
+	struct Eipdebuginfo info;
+
+	if (!kmalloc_tracking)
+		cprintf("kmalloc: tracking is off\n");
+	for (ks = kmalloc_sites; ks < kmalloc_sites + kmalloc_nsites; ks++) {
+		if (ks->ks_live == 0)
+			continue;
+		debuginfo_eip(ks->ks_eip, &info);
+		cprintf("%6u live %8u bytes  %s:%d: %.*s+%d\n",
+			ks->ks_live, ks->ks_bytes, info.eip_file, info.eip_line,
+			info.eip_fn_namelen, info.eip_fn_name,
+			ks->ks_eip - info.eip_fn_addr);
+	}
+	if (kmalloc_untracked)
+		cprintf("%u allocations not tracked (tables full)\n",
+			kmalloc_untracked);
+}
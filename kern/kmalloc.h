@@ -0,0 +1,27 @@
+#ifndef JOS_KERN_KMALLOC_H
+#define JOS_KERN_KMALLOC_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// General-purpose kernel heap.  Requests up to KMALLOC_MAX_SMALL bytes
+// are rounded up to a size class and served from that class's slab
+// cache; larger ones get a block of 2^n pages.
+
+#define KMALLOC_MAX_SMALL	2048	// largest slab size class
+#define KMALLOC_NSITES		64	// call sites tracked for leaks
+#define KMALLOC_NTRACK		1024	// live allocations tracked; a power of two
+
+void kmalloc_init(void);
+void *kmalloc(size_t size);
+void kfree(void *p);
+
+extern bool kmalloc_tracking;
+
+void kmalloc_track(bool on);
+void kmalloc_stats(void);
+void kmalloc_leaks(void);
+
+#endif	// !JOS_KERN_KMALLOC_H
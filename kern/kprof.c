@@ -0,0 +1,190 @@
+// Function entry/exit instrumentation.
+//
+// With KPROF=1 the kernel is compiled with -finstrument-functions, so
+// every function calls __cyg_profile_func_enter() on entry and
+// __cyg_profile_func_exit() on return.  The hooks keep a per-CPU
+// shadow stack of TSC timestamps and charge each function its
+// inclusive and exclusive cycles and call count.
+//
+// This file, kern/cpu.h and inc/x86.h are excluded from
+// instrumentation in kern/Makefrag, since the hooks use them.
+// The counts include some hook overhead, which mostly lands in the
+// exclusive time of very short functions.
+
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/x86.h>
+
+#include <kern/kprof.h>
+#include <kern/cpu.h>
+#include <kern/kdebug.h>
+
+bool kprof_enabled __read_mostly;
+
+static struct KprofCpu kprof_cpus[NCPU];
+
+bool
+kprof_available(void)
+{
+#ifdef KPROF
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+static struct KprofFunc *
+kprof_lookup(struct KprofCpu *kc, uintptr_t fn)
+{
+	uint32_t i, h = (fn >> 2) & (KPROF_NFUNCS - 1);
+
+	for (i = 0; i < KPROF_NFUNCS; i++) {
+		struct KprofFunc *kf = &kc->kc_funcs[(h + i) & (KPROF_NFUNCS - 1)];
+
+		if (kf->kf_addr == fn)
+			return kf;
+		if (kf->kf_addr == 0) {
+			kf->kf_addr = fn;
+			return kf;
+		}
+	}
+	return NULL;
+}
+
+void
+__cyg_profile_func_enter(void *fn, void *call_site)
+{
+	struct KprofCpu *kc;
+	struct KprofFrame *kf;
+	uint32_t eflags;
+
+	if (!kprof_enabled)
+		return;
+	// The timer interrupt may nest a call in here.
+	eflags = read_eflags();
+	asm volatile("cli");
+	kc = &kprof_cpus[cpunum()];
+	if (kc->kc_depth < KPROF_MAXDEPTH) {
+		kf = &kc->kc_stack[kc->kc_depth];
+		kf->kf_fn = (uintptr_t) fn;
+		kf->kf_children = 0;
+		kf->kf_start = read_tsc();
+	}
+	kc->kc_depth++;
+	write_eflags(eflags);
+}
+
+void
+__cyg_profile_func_exit(void *fn, void *call_site)
+{
+	uint64_t now = read_tsc(), incl;
+	struct KprofCpu *kc;
+	struct KprofFrame *kf;
+	struct KprofFunc *f;
+	uint32_t eflags;
+
+	if (!kprof_enabled)
+		return;
+	eflags = read_eflags();
+	asm volatile("cli");
+	kc = &kprof_cpus[cpunum()];
+	if (kc->kc_depth > KPROF_MAXDEPTH) {
+		kc->kc_depth--;
+		goto out;
+	}
+	// Ignore returns from frames entered before profiling started.
+	if (kc->kc_depth == 0
+	    || kc->kc_stack[kc->kc_depth - 1].kf_fn != (uintptr_t) fn)
+		goto out;
+
+	kf = &kc->kc_stack[--kc->kc_depth];
+	incl = now - kf->kf_start;
+	if (kc->kc_depth > 0)
+		kc->kc_stack[kc->kc_depth - 1].kf_children += incl;
+	if ((f = kprof_lookup(kc, kf->kf_fn)) != NULL) {
+		f->kf_calls++;
+		f->kf_incl += incl;
+		f->kf_excl += incl - kf->kf_children;
+	}
+out:
+	write_eflags(eflags);
+}
+
+// Turn profiling on with empty shadow stacks.  Frames left from an
+// earlier run, entered before a 'kprof off', would otherwise take the
+// exits of this run's calls; the exits of calls that are still
+// unfinished now find an empty or mismatched stack and are dropped.
+void
+kprof_start(void)
+{
+	int i;
+
+	kprof_enabled = 0;
+	for (i = 0; i < NCPU; i++) {
+		kprof_cpus[i].kc_depth = 0;
+		memset(kprof_cpus[i].kc_stack, 0,
+		       sizeof(kprof_cpus[i].kc_stack));
+	}
+	kprof_enabled = 1;
+}
+
+void
+kprof_reset(void)
+{
+	bool was_enabled = kprof_enabled;
+
+	kprof_enabled = 0;
+	memset(kprof_cpus, 0, sizeof(kprof_cpus));
+	kprof_enabled = was_enabled;
+}
+
+// Print the 'n' functions with the most exclusive cycles, as
+// "kprof <calls> <inclusive> <exclusive> <function>" lines.
+void
+kprof_report(int n)
+{
+	static struct KprofFunc all[KPROF_NFUNCS];
+	struct KprofFunc *f, tmp;
+	struct Eipdebuginfo info;
+	bool was_enabled = kprof_enabled;
+	int nall = 0, cpu, i, j;
+
+	kprof_enabled = 0;
+	for (cpu = 0; cpu < NCPU; cpu++) {
+		for (i = 0; i < KPROF_NFUNCS; i++) {
+			f = &kprof_cpus[cpu].kc_funcs[i];
+			if (f->kf_addr == 0)
+				continue;
+			for (j = 0; j < nall; j++)
+				if (all[j].kf_addr == f->kf_addr)
+					break;
+			if (j == nall)
+				memset(&all[nall++], 0, sizeof(all[0]));
+			all[j].kf_addr = f->kf_addr;
+			all[j].kf_calls += f->kf_calls;
+			all[j].kf_incl += f->kf_incl;
+			all[j].kf_excl += f->kf_excl;
+		}
+	}
+
+	// Partial selection sort: only the top 'n' need ordering.
+	n = MIN(n, nall);
+	for (i = 0; i < n; i++) {
+		for (j = i + 1; j < nall; j++) {
+			if (all[j].kf_excl > all[i].kf_excl) {
+				tmp = all[i];
+				all[i] = all[j];
+				all[j] = tmp;
+			}
+		}
+	}
+
+	cprintf("kprof: calls, inclusive cycles, exclusive cycles, function\n");
+	for (i = 0; i < n; i++) {
+		debuginfo_eip(all[i].kf_addr, &info);
+		cprintf("kprof %u %llu %llu %.*s\n", all[i].kf_calls,
+			all[i].kf_incl, all[i].kf_excl,
+			info.eip_fn_namelen, info.eip_fn_name);
+	}
+	kprof_enabled = was_enabled;
+}
@@ -0,0 +1,43 @@
+#ifndef JOS_KERN_KPROF_H
+#define JOS_KERN_KPROF_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/cache.h>
+
+// Exact per-function cycle accounting for kernels built with KPROF=1
+// (see kern/Makefrag).
+
+#define KPROF_MAXDEPTH	64	// shadow stack frames per CPU
+#define KPROF_NFUNCS	1024	// distinct functions tracked; a power of two
+
+struct KprofFrame {
+	uintptr_t kf_fn;
+	uint64_t kf_start;	// TSC at entry
+	uint64_t kf_children;	// cycles spent in recorded callees
+};
+
+struct KprofFunc {
+	uintptr_t kf_addr;	// 0 if this slot is free
+	uint32_t kf_calls;
+	uint64_t kf_incl;	// cycles including callees
+	uint64_t kf_excl;	// cycles in the function itself
+};
+
+struct KprofCpu {
+	int kc_depth;		// may exceed KPROF_MAXDEPTH; deeper
+				//  frames are not recorded
+	struct KprofFrame kc_stack[KPROF_MAXDEPTH];
+	struct KprofFunc kc_funcs[KPROF_NFUNCS];
+} ____cacheline_aligned;
+
+extern bool kprof_enabled;
+
+bool kprof_available(void);
+void kprof_start(void);
+void kprof_reset(void);
+void kprof_report(int n);
+
+#endif	// !JOS_KERN_KPROF_H
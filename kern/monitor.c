@@ -10,9 +10,20 @@
 #include <kern/console.h>
 #include <kern/monitor.h>
 #include <kern/kdebug.h>
+#include <kern/perf.h>
+#include <kern/bench.h>
+#include <kern/hwbench.h>
+#include <kern/trace.h>
+#include <kern/pmc.h>
+#include <kern/kprof.h>
+#include <kern/pmap.h>
+#include <kern/slab.h>
+#include <kern/kmalloc.h>
 
 #define CMDBUF_SIZE	80	// enough for one VGA text line
 
+static int runargv(int argc, char **argv, struct Trapframe *tf);
+
 
 struct Command {
 	const char *name;
@@ -25,6 +36,15 @@ static struct Command commands[] = {
 	{ "help", "Display this list of commands", mon_help },
 	{ "kerninfo", "Display information about the kernel", mon_kerninfo },
 	{ "backtrace", "Display backtrace", mon_backtrace },
+	{ "perf", "Sample kernel EIPs: perf start [-g] [hz] | stop | report | folded | hotlist [n]", mon_perf },
+	{ "bench", "Run microbenchmarks: bench [-l] [prefix...]", mon_bench },
+	{ "hwbench", "Measure caches, TLB, bandwidth: hwbench [lat|bw|tlb|upd]", mon_hwbench },
+	{ "trace", "Control tracepoints: trace on | off | clear | dump", mon_trace },
+	{ "pmc", "Count hardware events around a command: pmc [run [-f] <command>]", mon_pmc },
+	{ "kprof", "Per-function cycles (KPROF=1 builds): kprof on | off | reset | [n]", mon_kprof },
+	{ "pages", "Show free physical memory and fragmentation per order", mon_pages },
+	{ "slabinfo", "Show object caches and their slabs", mon_slabinfo },
+	{ "kmalloc", "Kernel heap usage and leaks: kmalloc [track on | off | leaks]", mon_kmalloc },
 };
 
 /***** Implementations of basic kernel monitor commands *****/
@@ -74,21 +94,199 @@ mon_backtrace(int argc, char **argv, struct Trapframe *tf)
 	return 0;
 }
 
+int
+mon_perf(int argc, char **argv, struct Trapframe *tf)
+{
+	bool callchain = 0;
+	int hz = 1000;
+	int i;
+
+	if (argc < 2)
+		goto usage;
+	if (strcmp(argv[1], "start") == 0) {
+		for (i = 2; i < argc; i++) {
+			if (strcmp(argv[i], "-g") == 0)
+				callchain = 1;
+			else
+				hz = strtol(argv[i], NULL, 0);
+		}
+		if (hz < 19 || hz > 10000) {
+			cprintf("perf: rate must be 19-10000 Hz\n");
+			return 0;
+		}
+		perf_start(hz, callchain);
+	} else if (strcmp(argv[1], "stop") == 0)
+		perf_stop();
+	else if (strcmp(argv[1], "report") == 0)
+		perf_report();
+	else if (strcmp(argv[1], "folded") == 0)
+		perf_folded();
+	else if (strcmp(argv[1], "hotlist") == 0)
+		perf_hotlist(argc > 2 ? strtol(argv[2], NULL, 0) : 32);
+	else
+		goto usage;
+	return 0;
+
+usage:
+	cprintf("usage: perf start [-g] [hz] | stop | report | folded | hotlist [n]\n");
+	return 0;
+}
+
+int
+mon_bench(int argc, char **argv, struct Trapframe *tf)
+{
+	int i;
+
+	if (argc == 2 && strcmp(argv[1], "-l") == 0) {
+		bench_list();
+		return 0;
+	}
+	cprintf("bench begin overhead-corrected cycles, %d trials\n",
+		BENCH_TRIALS);
+	if (argc == 1)
+		bench_run(NULL);
+	for (i = 1; i < argc; i++)
+		if (bench_run(argv[i]) == 0)
+			cprintf("bench: no benchmark matches '%s'\n", argv[i]);
+	cprintf("bench end\n");
+	return 0;
+}
+
+int
+mon_hwbench(int argc, char **argv, struct Trapframe *tf)
+{
+	const char *which = argc > 1 ? argv[1] : "all";
+	bool all = strcmp(which, "all") == 0;
+
+	if (all || strcmp(which, "lat") == 0)
+		hwbench_latency();
+	if (all || strcmp(which, "bw") == 0)
+		hwbench_bandwidth();
+	if (all || strcmp(which, "tlb") == 0)
+		hwbench_tlb();
+	if (all || strcmp(which, "upd") == 0)
+		hwbench_update();
+	if (!all && strcmp(which, "lat") && strcmp(which, "bw")
+	    && strcmp(which, "tlb") && strcmp(which, "upd"))
+		cprintf("usage: hwbench [lat|bw|tlb|upd]\n");
+	return 0;
+}
+
+int
+mon_trace(int argc, char **argv, struct Trapframe *tf)
+{
+	if (argc != 2)
+		goto usage;
+	if (strcmp(argv[1], "on") == 0) {
+		trace_enabled = 1;
+		TRACE_EVENT("trace_on", 0, 0);
+	} else if (strcmp(argv[1], "off") == 0)
+		trace_enabled = 0;
+	else if (strcmp(argv[1], "clear") == 0)
+		trace_clear();
+	else if (strcmp(argv[1], "dump") == 0)
+		trace_dump();
+	else
+		goto usage;
+	return 0;
+
+usage:
+	cprintf("usage: trace on | off | clear | dump\n");
+	return 0;
+}
+
+int
+mon_pmc(int argc, char **argv, struct Trapframe *tf)
+{
+	int set = PMC_SET_DEFAULT;
+	int r;
+
+	if (argc == 1) {
+		pmc_info();
+		return 0;
+	}
+	if (argc < 3 || strcmp(argv[1], "run") != 0)
+		goto usage;
+	argc -= 2;
+	argv += 2;
+	if (strcmp(argv[0], "-f") == 0) {
+		set = PMC_SET_FRONTEND;
+		argc--;
+		argv++;
+		if (argc == 0)
+			goto usage;
+	}
+	pmc_start(set);
+	r = runargv(argc, argv, tf);
+	pmc_report();
+	return r;
+
+usage:
+	cprintf("usage: pmc [run [-f] <command>]\n");
+	return 0;
+}
+
+int
+mon_kprof(int argc, char **argv, struct Trapframe *tf)
+{
+	if (!kprof_available()) {
+		cprintf("kprof: kernel not built with KPROF=1\n");
+		return 0;
+	}
+	if (argc == 1)
+		kprof_report(20);
+	else if (strcmp(argv[1], "on") == 0)
+		kprof_start();
+	else if (strcmp(argv[1], "off") == 0)
+		kprof_enabled = 0;
+	else if (strcmp(argv[1], "reset") == 0)
+		kprof_reset();
+	else
+		kprof_report(strtol(argv[1], NULL, 0));
+	return 0;
+}
+
+int
+mon_pages(int argc, char **argv, struct Trapframe *tf)
+{
+	page_stats();
+	return 0;
+}
+
+int
+mon_slabinfo(int argc, char **argv, struct Trapframe *tf)
+{
+	slab_info();
+	return 0;
+}
+
+int
+mon_kmalloc(int argc, char **argv, struct Trapframe *tf)
+{
+	if (argc == 1)
+		kmalloc_stats();
+	else if (strcmp(argv[1], "leaks") == 0)
+		kmalloc_leaks();
+	else if (argc == 3 && strcmp(argv[1], "track") == 0
+		 && (strcmp(argv[2], "on") == 0 || strcmp(argv[2], "off") == 0))
+		kmalloc_track(strcmp(argv[2], "on") == 0);
+	else
+		cprintf("usage: kmalloc [track on | off | leaks]\n");
+	return 0;
+}
 
 
 /***** Kernel monitor command interpreter *****/
 
 #define WHITESPACE "\t\r\n "
-#define MAXARGS 16
 
-static int
-runcmd(char *buf, struct Trapframe *tf)
+// Split 'buf' in place into whitespace-separated arguments.
+// Returns the argument count, or -1 if there are too many.
+int
+parse_cmd(char *buf, char **argv)
 {
 	int argc;
-	char *argv[MAXARGS];
-	int i;
 
-	// Parse the command buffer into whitespace-separated arguments
 	argc = 0;
 	argv[argc] = 0;
 	while (1) {
@@ -99,27 +297,62 @@ runcmd(char *buf, struct Trapframe *tf)
 			break;
 
 		// save and scan past next arg
-		if (argc == MAXARGS-1) {
-			cprintf("Too many arguments (max %d)\n", MAXARGS);
-			return 0;
-		}
+		if (argc == MAXARGS-1)
+			return -1;
 		argv[argc++] = buf;
 		while (*buf && !strchr(WHITESPACE, *buf))
 			buf++;
 	}
 	argv[argc] = 0;
+	return argc;
+}
+
+// Invoke the command named by argv[0].
+static int
+runargv(int argc, char **argv, struct Trapframe *tf)
+{
+	bool traced;
+	int i, r;
 
-	// Lookup and invoke the command
-	if (argc == 0)
-		return 0;
 	for (i = 0; i < ARRAY_SIZE(commands); i++) {
-		if (strcmp(argv[0], commands[i].name) == 0)
-			return commands[i].func(argc, argv, tf);
+		if (strcmp(argv[0], commands[i].name) == 0) {
+			// Record both ends of the duration or neither, so
+			// the dump stays balanced.  The trace command itself
+			// is left out: it switches tracing on and off and
+			// clears and prints the rings in between.
+			traced = trace_enabled && commands[i].func != mon_trace;
+			if (traced)
+				trace_record(commands[i].name, 0, 0,
+					     TRACE_PH_BEGIN);
+			r = commands[i].func(argc, argv, tf);
+			if (traced)
+				trace_record(commands[i].name, 0, 0,
+					     TRACE_PH_END);
+			return r;
+		}
 	}
 	cprintf("Unknown command '%s'\n", argv[0]);
 	return 0;
 }
 
+static int
+runcmd(char *buf, struct Trapframe *tf)
+{
+	int argc;
+	char *argv[MAXARGS];
+
+	// Parse the command buffer into whitespace-separated arguments
+	if ((argc = parse_cmd(buf, argv)) < 0) {
+		cprintf("Too many arguments (max %d)\n", MAXARGS);
+		return 0;
+	}
+
+	// Lookup and invoke the command
+	if (argc == 0)
+		return 0;
+	return runargv(argc, argv, tf);
+}
+
 void
 monitor(struct Trapframe *tf)
 {
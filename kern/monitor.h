@@ -6,14 +6,28 @@
 
 struct Trapframe;
 
+#define MAXARGS 16	// maximum arguments to a monitor command
+
 // Activate the kernel monitor,
 // optionally providing a trap frame indicating the current state
 // (NULL if none).
 void monitor(struct Trapframe *tf);
 
+// Split a command line into arguments; argv needs MAXARGS entries.
+int parse_cmd(char *buf, char **argv);
+
 // Functions implementing monitor commands.
 int mon_help(int argc, char **argv, struct Trapframe *tf);
 int mon_kerninfo(int argc, char **argv, struct Trapframe *tf);
 int mon_backtrace(int argc, char **argv, struct Trapframe *tf);
+int mon_perf(int argc, char **argv, struct Trapframe *tf);
+int mon_bench(int argc, char **argv, struct Trapframe *tf);
+int mon_hwbench(int argc, char **argv, struct Trapframe *tf);
+int mon_trace(int argc, char **argv, struct Trapframe *tf);
+int mon_pmc(int argc, char **argv, struct Trapframe *tf);
+int mon_kprof(int argc, char **argv, struct Trapframe *tf);
+int mon_pages(int argc, char **argv, struct Trapframe *tf);
+int mon_slabinfo(int argc, char **argv, struct Trapframe *tf);
+int mon_kmalloc(int argc, char **argv, struct Trapframe *tf);
 
 #endif	// !JOS_KERN_MONITOR_H
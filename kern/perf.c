@@ -0,0 +1,190 @@
+// Timer-driven sampling profiler for the kernel.
+//
+// While running, every timer interrupt records the interrupted EIP, and
+// optionally the caller chain, into the current CPU's sample buffer.
+// Samples are only symbolized when a report is requested.
+
+#include <inc/stdio.h>
+#include <inc/x86.h>
+#include <inc/trap.h>
+#include <inc/assert.h>
+
+#include <kern/perf.h>
+#include <kern/cpu.h>
+#include <kern/kclock.h>
+#include <kern/kdebug.h>
+
+static struct PerfCpu perf_cpus[NCPU];
+static bool perf_callchain;
+static bool perf_running;
+static uint64_t perf_start_ns, perf_stop_ns;
+
+void
+perf_start(int hz, bool callchain)
+{
+	int i;
+
+	if (perf_running)
+		perf_stop();
+	for (i = 0; i < NCPU; i++) {
+		perf_cpus[i].pc_nsamples = 0;
+		perf_cpus[i].pc_dropped = 0;
+	}
+	perf_callchain = callchain;
+	perf_running = 1;
+	perf_start_ns = clock_ns();
+	kclock_start(hz);
+	asm volatile("sti");
+}
+
+void
+perf_stop(void)
+{
+	asm volatile("cli");
+	kclock_stop();
+	perf_running = 0;
+	perf_stop_ns = clock_ns();
+}
+
+// Called from trap() on every timer interrupt.  Keep this cheap:
+// no symbolization and no console output.
+void
+perf_sample(struct Trapframe *tf)
+{
+	struct PerfCpu *pc = &perf_cpus[cpunum()];
+	struct PerfSample *ps;
+
+	if (pc->pc_nsamples == PERF_NSAMPLES) {
+		pc->pc_dropped++;
+		return;
+	}
+	ps = &pc->pc_samples[pc->pc_nsamples++];
+	ps->ps_pcs[0] = tf->tf_eip;
+	ps->ps_depth = 1;
+	if (perf_callchain)
+		ps->ps_depth += capture_stack_from(tf->tf_regs.reg_ebp,
+						   ps->ps_pcs + 1,
+						   PERF_MAXDEPTH - 1);
+}
+
+#define PERF_MAXFUNCS	256
+
+struct PerfFunc {
+	uintptr_t pf_addr;
+	const char *pf_name;
+	int pf_namelen;
+	uint32_t pf_count;
+};
+
+static struct PerfFunc perf_funcs[PERF_MAXFUNCS];
+
+// Aggregate all samples by function into perf_funcs, hottest first.
+// Returns the number of functions; samples beyond PERF_MAXFUNCS
+// distinct functions are counted in *other.
+static int
+perf_aggregate(uint32_t *other)
+{
+	struct PerfFunc *funcs = perf_funcs, tmp;
+	struct Eipdebuginfo info;
+	int nfuncs = 0, cpu, i, j;
+
+	*other = 0;
+	for (cpu = 0; cpu < NCPU; cpu++) {
+		struct PerfCpu *pc = &perf_cpus[cpu];
+
+		for (i = 0; i < pc->pc_nsamples; i++) {
+			debuginfo_eip(pc->pc_samples[i].ps_pcs[0], &info);
+			for (j = 0; j < nfuncs; j++)
+				if (funcs[j].pf_addr == info.eip_fn_addr)
+					break;
+			if (j == nfuncs) {
+				if (nfuncs == PERF_MAXFUNCS) {
+					(*other)++;
+					continue;
+				}
+				funcs[j].pf_addr = info.eip_fn_addr;
+				funcs[j].pf_name = info.eip_fn_name;
+				funcs[j].pf_namelen = info.eip_fn_namelen;
+				funcs[j].pf_count = 0;
+				nfuncs++;
+			}
+			funcs[j].pf_count++;
+		}
+	}
+
+	// Insertion sort, most samples first.
+	for (i = 1; i < nfuncs; i++) {
+		tmp = funcs[i];
+		for (j = i; j > 0 && funcs[j-1].pf_count < tmp.pf_count; j--)
+			funcs[j] = funcs[j-1];
+		funcs[j] = tmp;
+	}
+	return nfuncs;
+}
+
+// Print sample counts aggregated by function, hottest first.
+// Each line is "<count> <percent> <function>".
+void
+perf_report(void)
+{
+	uint32_t total = 0, dropped = 0, other;
+	uint64_t end = perf_running ? clock_ns() : perf_stop_ns;
+	int nfuncs, cpu, i;
+
+	for (cpu = 0; cpu < NCPU; cpu++) {
+		total += perf_cpus[cpu].pc_nsamples;
+		dropped += perf_cpus[cpu].pc_dropped;
+	}
+	nfuncs = perf_aggregate(&other);
+
+	cprintf("perf: %u samples, %u dropped, %u ms\n", total, dropped,
+		(uint32_t) ((end - perf_start_ns) / 1000000));
+	if (total == 0)
+		return;
+	for (i = 0; i < nfuncs; i++)
+		cprintf("%8u %3u%% %.*s\n", perf_funcs[i].pf_count,
+			perf_funcs[i].pf_count * 100 / total,
+			perf_funcs[i].pf_namelen, perf_funcs[i].pf_name);
+	if (other)
+		cprintf("%8u %3u%% <other>\n", other, other * 100 / total);
+}
+
+// Print the names of the 'n' hottest functions in the format of
+// kern/hot.list, which orders them first in the kernel's .text.
+void
+perf_hotlist(int n)
+{
+	uint32_t other;
+	int nfuncs, i;
+
+	nfuncs = perf_aggregate(&other);
+	cprintf("# kern/hot.list: generated by 'perf hotlist'\n");
+	for (i = 0; i < nfuncs && i < n; i++)
+		cprintf("%.*s\n", perf_funcs[i].pf_namelen,
+			perf_funcs[i].pf_name);
+	cprintf("# end\n");
+}
+
+// Print every sample as a folded stack ("outer;inner;leaf 1"), the
+// input format of flamegraph.pl.  Capture the serial log on the host
+// and feed the lines between the markers to it.
+void
+perf_folded(void)
+{
+	struct Eipdebuginfo info;
+	struct PerfSample *ps;
+	int cpu, i, d;
+
+	cprintf("# perf folded begin\n");
+	for (cpu = 0; cpu < NCPU; cpu++) {
+		for (i = 0; i < perf_cpus[cpu].pc_nsamples; i++) {
+			ps = &perf_cpus[cpu].pc_samples[i];
+			for (d = ps->ps_depth - 1; d >= 0; d--) {
+				debuginfo_eip(ps->ps_pcs[d], &info);
+				cprintf("%.*s%s", info.eip_fn_namelen,
+					info.eip_fn_name, d ? ";" : " 1\n");
+			}
+		}
+	}
+	cprintf("# perf folded end\n");
+}
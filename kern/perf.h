@@ -0,0 +1,34 @@
+#ifndef JOS_KERN_PERF_H
+#define JOS_KERN_PERF_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/cache.h>
+
+struct Trapframe;
+
+#define PERF_NSAMPLES	2048	// samples buffered per CPU
+#define PERF_MAXDEPTH	8	// EIPs recorded per sample, including leaf
+
+struct PerfSample {
+	uint32_t ps_depth;		// valid entries in ps_pcs
+	uintptr_t ps_pcs[PERF_MAXDEPTH];// interrupted EIP, then callers
+};
+
+// Per-CPU sample buffer, filled by the timer interrupt.
+struct PerfCpu {
+	uint32_t pc_nsamples;
+	uint32_t pc_dropped;		// samples lost to a full buffer
+	struct PerfSample pc_samples[PERF_NSAMPLES];
+} ____cacheline_aligned;
+
+void perf_start(int hz, bool callchain);
+void perf_stop(void);
+void perf_sample(struct Trapframe *tf);
+void perf_report(void);
+void perf_folded(void);
+void perf_hotlist(int n);
+
+#endif	// !JOS_KERN_PERF_H
@@ -0,0 +1,1437 @@
+/* See COPYRIGHT for copyright information. */
+
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/error.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+#include <inc/multiboot.h>
+
+#include <kern/pmap.h>
+#include <kern/kclock.h>
+#include <kern/cpu.h>
+
+#define CPUID_PSE	(1 << 3)	// CPUID.01H:EDX: 4MB pages
+#define CPUID_SSE2	(1 << 26)	// CPUID.01H:EDX: includes movnti
+#define CPUID_NX	(1 << 20)	// CPUID.80000001H:EDX: no-execute
+#define MEM_MAXRANGES	32		// usable physical memory ranges
+
+// Physical memory is used up to MEM_TOP.  Without PAE that is the last
+// page a 32-bit address can reach; with PAE, 64GB, whose PageInfo
+// array still leaves some of the direct map for the kernel.
+#ifdef PAE
+#define MEM_TOP		(1ULL << 36)
+#else
+#define MEM_TOP		((uint64_t) (physaddr_t) -PGSIZE)
+#endif
+
+// A page directory is a block of 2^PGDIR_ORDER pages: the four page
+// directories of a PAE address space sit together.
+#ifdef PAE
+#define PGDIR_ORDER	2
+#else
+#define PGDIR_ORDER	0
+#endif
+
+// These variables are set by i386_detect_memory()
+size_t npages;			// Amount of physical memory (in pages)
+size_t npages_low;		// Pages below the direct map's end
+static size_t npages_basemem;	// Amount of base memory (in pages)
+
+// Page-aligned ranges of usable RAM, [mr_start, mr_end), also set by
+// i386_detect_memory(); possibly unsorted and overlapping.
+struct MemRange {
+	physaddr_t mr_start;
+	physaddr_t mr_end;
+};
+static struct MemRange mem_ranges[MEM_MAXRANGES];
+static int mem_nranges;
+
+// Saved by entry.S
+extern uint32_t multiboot_magic;
+extern uint32_t multiboot_info;
+
+// These variables are set in mem_init()
+pde_t *kern_pgdir;		// Kernel's initial page directory
+struct PageInfo *pages;		// Physical page state array
+
+// Memory past the direct map is highmem.  It has its own free lists,
+// so kernel allocations never see it; it is handed out only to callers
+// that ask for ALLOC_HIGH, which is what user memory should use.
+enum {
+	ZONE_LOW,
+	ZONE_HIGH,
+	PAGE_NZONES
+};
+
+// Buddy allocator state: per zone, a doubly linked free list per
+// order, so a block can be unlinked in O(1) when its buddy is freed.
+static struct PageInfo *page_free_list[PAGE_NZONES][PAGE_NORDERS];
+static size_t page_free_blocks[PAGE_NZONES][PAGE_NORDERS];
+static size_t page_nfree[PAGE_NZONES];	// free pages on the lists
+
+// Next free slot in each CPU's kmap window, and the page table
+// entries that map all the windows.
+static int kmap_depth[NCPU];
+static pte_t *kmap_ptes;
+
+// Set in mem_init() if the pre-zeroed pool can use movnti.
+static bool page_movnti __read_mostly;
+
+// PTE_NX, set in mem_init() if the CPU has it, else 0.  Mappings of
+// memory that never holds code carry it.
+static pte_t pte_nx __read_mostly;
+
+#ifdef PAE
+// Each CPU's page directory pointer table, which pgdir_load points at
+// the four page directories of the address space being loaded.  It
+// has to be below 4GB and 32-byte aligned.
+static pde_t pgdir_pdpt[NCPU][NPDPENTRIES] __attribute__((__aligned__(32)));
+#endif
+
+// Per-CPU single-page caches of lowmem.  Each is only touched by its own CPU,
+// and the kernel neither preempts itself nor allocates pages from
+// interrupt handlers, so they need no lock.  Only refills and drains
+// reach the buddy lists, which are shared; with more than one CPU
+// running those are the only calls that need the allocator lock.
+static struct PageCpu page_cpus[NCPU];
+
+
+// --------------------------------------------------------------
+// Detect machine's physical memory setup.
+// --------------------------------------------------------------
+
+static int
+nvram_read(int r)
+{
+	return mc146818_read(r) | (mc146818_read(r + 1) << 8);
+}
+
+// Record usable RAM [start, start+len), trimmed to whole pages below
+// MEM_TOP.  Returns the KB left out above.
+static size_t
+mem_add_range(uint64_t start, uint64_t len)
+{
+	uint64_t end = start + len, top = MEM_TOP;
+	size_t ignored;
+
+	start = (start + PGSIZE - 1) & ~(uint64_t) (PGSIZE - 1);
+	end &= ~(uint64_t) (PGSIZE - 1);
+	if (start >= end)
+		return 0;
+	ignored = end > top ? (end - MAX(start, top)) >> 10 : 0;
+	end = MIN(end, top);
+	if (start < end && mem_nranges < MEM_MAXRANGES) {
+		mem_ranges[mem_nranges].mr_start = start;
+		mem_ranges[mem_nranges].mr_end = end;
+		mem_nranges++;
+	}
+	return ignored;
+}
+
+// Take the usable ranges from the multiboot memory map, as passed by
+// GRUB or by boot/main.c from the BIOS E820 map.  Returns the KB left
+// out above MEM_TOP, or -1 if there is no map.
+static int
+mem_detect_multiboot(void)
+{
+	struct multiboot_info *mbi;
+	struct multiboot_mmap_entry *e;
+	uintptr_t p, end;
+	size_t ignored = 0;
+
+	// Only entry_pgdir's first PTSIZE is mapped so far.
+	if (multiboot_magic != MULTIBOOT_BOOTLOADER_MAGIC
+	    || multiboot_info + sizeof(*mbi) > PTSIZE)
+		return -1;
+	mbi = (struct multiboot_info *) (multiboot_info + KERNBASE);
+	if (!(mbi->flags & MULTIBOOT_INFO_MEM_MAP)
+	    || mbi->mmap_addr + mbi->mmap_length > PTSIZE)
+		return -1;
+
+	p = mbi->mmap_addr + KERNBASE;
+	end = p + mbi->mmap_length;
+	for (; p < end; p += e->size + 4) {
+		e = (struct multiboot_mmap_entry *) p;
+		if (e->type == MULTIBOOT_MEMORY_AVAILABLE)
+			ignored += mem_add_range(e->addr, e->len);
+	}
+	return mem_nranges ? ignored : -1;
+}
+
+static bool
+mem_usable(physaddr_t pa)
+{
+	int i;
+
+	for (i = 0; i < mem_nranges; i++)
+		if (pa >= mem_ranges[i].mr_start && pa < mem_ranges[i].mr_end)
+			return 1;
+	return 0;
+}
+
+static void
+i386_detect_memory(void)
+{
+	size_t basemem, extmem, ext16mem, totalmem;
+	int i, ignored;
+
+	// Use CMOS calls to measure available base & extended memory.
+	// (CMOS calls return results in kilobytes.)
+	basemem = nvram_read(NVRAM_BASELO);
+	extmem = nvram_read(NVRAM_EXTLO);
+	ext16mem = nvram_read(NVRAM_EXT16LO) * 64;
+	npages_basemem = basemem / (PGSIZE / 1024);
+
+	// Prefer the boot loader's memory map, which covers all of RAM
+	// and its holes.  The NVRAM only describes one range below 16MB
+	// and one above, and caps the latter at 4GB.
+	if ((ignored = mem_detect_multiboot()) < 0) {
+		ignored = 0;
+		if (ext16mem)
+			totalmem = 16 * 1024 + ext16mem;
+		else if (extmem)
+			totalmem = 1 * 1024 + extmem;
+		else
+			totalmem = basemem;
+		mem_add_range(0, basemem * 1024);
+		if (totalmem > 1024)
+			ignored = mem_add_range(EXTPHYSMEM,
+						(totalmem - 1024) * 1024ULL);
+	}
+
+	npages = 0;
+	totalmem = 0;
+	for (i = 0; i < mem_nranges; i++) {
+		npages = MAX(npages, (size_t) (mem_ranges[i].mr_end >> PGSHIFT));
+		totalmem += (mem_ranges[i].mr_end - mem_ranges[i].mr_start) / 1024;
+	}
+	npages_low = MIN(npages, PGNUM(-KERNBASE));
+
+	cprintf("Physical memory: %uK available, base = %uK, extended = %uK\n",
+		totalmem, basemem, totalmem - basemem);
+	if (npages > npages_low)
+		cprintf("Physical memory: highmem above %uK\n",
+			npages_low * (PGSIZE / 1024));
+#ifdef PAE
+	if (ignored)
+		cprintf("Physical memory: %uK above 64GB unused\n", ignored);
+#else
+	if (ignored)
+		cprintf("Physical memory: %uK above 4GB unused without PAE\n",
+			ignored);
+#endif
+}
+
+
+// --------------------------------------------------------------
+// Set up memory mappings above UTOP.
+// --------------------------------------------------------------
+
+static void boot_map_direct(pde_t *pgdir);
+static void boot_map_region(pde_t *pgdir, uintptr_t va, size_t size, physaddr_t pa, pte_t perm);
+static void pgdir_map_uvpt(pde_t *pgdir);
+static void check_page_alloc(void);
+static void check_cow(void);
+static int pt_unshare(pde_t *pde);
+
+// This simple physical memory allocator is used only while JOS is setting
+// up its virtual memory system.  page_alloc() is the real allocator.
+//
+// If n>0, allocates enough pages of contiguous physical memory to hold 'n'
+// bytes.  Doesn't initialize the memory.  Returns a kernel virtual address.
+//
+// If n==0, returns the address of the next free page without allocating
+// anything.
+//
+// If we're out of memory, boot_alloc should panic.
+// This function may ONLY be used during initialization,
+// before the page_free_list list has been set up.
+//
+// Until mem_init switches to kern_pgdir, only entry_pgdir's first
+// PTSIZE is mapped; after that, all of lowmem is.
+static uintptr_t boot_alloc_top = KERNBASE + PTSIZE;
+
+static void *
+boot_alloc(uint32_t n)
+{
+	static char *nextfree;	// virtual address of next byte of free memory
+	char *result, *p;
+
+	// Initialize nextfree if this is the first time.
+	// 'end' is a magic symbol automatically generated by the linker,
+	// which points to the end of the kernel's bss segment:
+	// the first virtual address that the linker did *not* assign
+	// to any kernel code or global variables.
+	if (!nextfree) {
+		extern char end[];
+		nextfree = ROUNDUP((char *) end, PGSIZE);
+	}
+
+	result = nextfree;
+	nextfree = ROUNDUP(nextfree + n, PGSIZE);
+	if ((uintptr_t) nextfree > boot_alloc_top)
+		panic("boot_alloc: out of memory");
+	for (p = result; p < nextfree; p += PGSIZE)
+		if (!mem_usable(PADDR(p)))
+			panic("boot_alloc: out of memory at %08llx",
+			      (uint64_t) PADDR(p));
+	return result;
+}
+
+// Set up a two-level page table, or with PAE a three-level one:
+//    kern_pgdir is its linear (virtual) address of the root
+//
+// From UTOP to ULIM, the user is allowed to read but not write.
+// Above ULIM the user cannot read or write.
+void
+mem_init(void)
+{
+	uint32_t cr0, eax, edx;
+
+	// Find out how much memory the machine has (npages & npages_basemem).
+	i386_detect_memory();
+
+	cpuid(1, NULL, NULL, NULL, &edx);
+	page_movnti = (edx & CPUID_SSE2) != 0;
+
+#ifdef PAE
+	// No-execute pages need EFER_NXE, without which bit 63 of an
+	// entry is reserved.
+	cpuid(0x80000000, &eax, NULL, NULL, NULL);
+	if (eax >= 0x80000001) {
+		cpuid(0x80000001, NULL, NULL, NULL, &edx);
+		if (edx & CPUID_NX) {
+			wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_NXE);
+			pte_nx = PTE_NX;
+		}
+	}
+#endif
+
+	// create initial page directory.
+	kern_pgdir = (pde_t *) boot_alloc(PGSIZE << PGDIR_ORDER);
+	memset(kern_pgdir, 0, PGSIZE << PGDIR_ORDER);
+
+	// Recursively insert PD in itself as a page table, to form
+	// a virtual page table at virtual address UVPT.
+	pgdir_map_uvpt(kern_pgdir);
+
+	// Map lowmem at KERNBASE and switch to kern_pgdir first: with
+	// highmem, the PageInfo array may not fit in entry_pgdir's
+	// PTSIZE, and from here on page_alloc() may return pages anywhere
+	// in lowmem.
+	boot_map_direct(kern_pgdir);
+	pgdir_load(kern_pgdir);
+	assert(curpgdir() == kern_pgdir);
+	boot_alloc_top = KERNBASE + npages_low * PGSIZE;
+
+	// Allocate the array of PageInfo structures, one per physical page.
+	pages = (struct PageInfo *) boot_alloc(npages * sizeof(struct PageInfo));
+	memset(pages, 0, npages * sizeof(struct PageInfo));
+
+	// Now that we've allocated the initial kernel data structures, we set
+	// up the list of free physical pages.
+	page_init();
+
+	// Map 'pages' read-only by the user at linear address UPAGES.
+	// Past about 1.3GB of memory the array outgrows the region, and
+	// only its first PTSIZE is visible there.
+	boot_map_region(kern_pgdir, UPAGES,
+			MIN(ROUNDUP(npages * sizeof(struct PageInfo), PGSIZE),
+			    PTSIZE),
+			PADDR(pages), PTE_U | pte_nx);
+
+	// Use the physical memory that 'bootstack' refers to as the kernel
+	// stack.  Only [KSTACKTOP-KSTKSIZE, KSTACKTOP) is backed; the guard
+	// page range below it is left unmapped.
+	boot_map_region(kern_pgdir, KSTACKTOP - KSTKSIZE, KSTKSIZE,
+			PADDR(bootstack), PTE_W | pte_nx);
+	tlbflush();
+
+	// The kmap windows share the kernel stacks' page table, which
+	// boot_map_region just created; their entries start out clear.
+	kmap_ptes = pgdir_walk(kern_pgdir, (void *) KMAPBASE, 0);
+	assert(kmap_ptes && PTX(KMAPBASE) == 0);
+
+	check_page_alloc();
+	check_cow();
+
+	// entry.S set the really important flags in cr0 (including enabling
+	// paging).  Here we configure the rest of the flags that we care about.
+	cr0 = rcr0();
+	cr0 |= CR0_PE|CR0_PG|CR0_AM|CR0_WP|CR0_NE|CR0_MP;
+	cr0 &= ~(CR0_TS|CR0_EM);
+	lcr0(cr0);
+}
+
+// Map [KERNBASE, 2^32) to physical [0, 2^32 - KERNBASE), with large
+// pages: 2MB with PAE, else 4MB when the CPU has them.  Otherwise the
+// page tables come from boot_alloc, since this runs before the page
+// allocator is set up.  Only the kernel's text needs to be executable.
+static void
+boot_map_direct(pde_t *pgdir)
+{
+	extern char etext[];
+	physaddr_t pa;
+	uint32_t edx;
+	pte_t *pt;
+	int i;
+
+#ifndef PAE
+	cpuid(1, NULL, NULL, NULL, &edx);
+	if (!(edx & CPUID_PSE)) {
+		for (pa = 0; pa < -KERNBASE; pa += PTSIZE) {
+			pt = (pte_t *) boot_alloc(PGSIZE);
+			for (i = 0; i < NPTENTRIES; i++)
+				pt[i] = (pa + i * PGSIZE) | PTE_W | PTE_P;
+			pgdir[PDX(KERNBASE + pa)] = PADDR(pt) | PTE_W | PTE_P;
+		}
+		return;
+	}
+	lcr4(rcr4() | CR4_PSE);
+#endif
+	for (pa = 0; pa < -KERNBASE; pa += PTSIZE)
+		pgdir[PDX(KERNBASE + pa)] = pa | PTE_PS | PTE_W | PTE_P
+			| (pa < PADDR(etext) ? 0 : pte_nx);
+}
+
+
+// --------------------------------------------------------------
+// Tracking of physical pages.
+// The 'pages' array has one 'struct PageInfo' entry per physical page.
+// Free pages are grouped into naturally aligned blocks of 2^order
+// pages, kept on the free list of their order.  A block's buddy is the
+// other half of the next larger block; when both halves are free
+// they are merged.  The direct map ends on a 4MB boundary, so no block
+// straddles the two zones.
+// --------------------------------------------------------------
+
+static void
+page_list_push(struct PageInfo *pp, int order)
+{
+	int zone = page_is_high(pp);
+
+	pp->pp_order = order;
+	pp->pp_flags |= PP_FREE;
+	pp->pp_prev = NULL;
+	pp->pp_link = page_free_list[zone][order];
+	if (pp->pp_link)
+		pp->pp_link->pp_prev = pp;
+	page_free_list[zone][order] = pp;
+	page_free_blocks[zone][order]++;
+	page_nfree[zone] += 1 << order;
+}
+
+static void
+page_list_remove(struct PageInfo *pp)
+{
+	int zone = page_is_high(pp), order = pp->pp_order;
+
+	if (pp->pp_prev)
+		pp->pp_prev->pp_link = pp->pp_link;
+	else
+		page_free_list[zone][order] = pp->pp_link;
+	if (pp->pp_link)
+		pp->pp_link->pp_prev = pp->pp_prev;
+	pp->pp_link = pp->pp_prev = NULL;
+	pp->pp_flags &= ~PP_FREE;
+	page_free_blocks[zone][order]--;
+	page_nfree[zone] -= 1 << order;
+}
+
+// Take a block of 2^order pages off the zone's buddy lists, splitting
+// the smallest free block that fits and returning the unused upper
+// halves to the lists.  Returns NULL if no block that large is free.
+static struct PageInfo *
+buddy_alloc(int zone, int order)
+{
+	struct PageInfo *pp;
+	int j;
+
+	for (j = order; j <= PAGE_MAX_ORDER && !page_free_list[zone][j]; j++)
+		/* do nothing */;
+	if (j > PAGE_MAX_ORDER)
+		return NULL;
+	pp = page_free_list[zone][j];
+	page_list_remove(pp);
+	while (j > order) {
+		j--;
+		page_list_push(pp + (1 << j), j);
+	}
+	pp->pp_order = order;
+	return pp;
+}
+
+// Put a block back on the buddy lists, merging it with its buddy for
+// as long as the buddy is free too.
+static void
+buddy_free(struct PageInfo *pp)
+{
+	size_t idx = pp - pages, bidx;
+	int order = pp->pp_order;
+	struct PageInfo *buddy;
+
+	for (; order < PAGE_MAX_ORDER; order++) {
+		bidx = idx ^ (1 << order);
+		if (bidx + (1 << order) > npages)
+			break;
+		buddy = &pages[bidx];
+		if (!(buddy->pp_flags & PP_FREE) || buddy->pp_order != order)
+			break;
+		page_list_remove(buddy);
+		idx &= ~(1 << order);
+	}
+	page_list_push(&pages[idx], order);
+}
+
+//
+// Initialize page structure and memory free list.
+// After this is done, NEVER use boot_alloc again.  ONLY use the page
+// allocator functions below to allocate and deallocate physical
+// memory via the free lists.
+//
+void
+page_init(void)
+{
+	size_t i, first_free = PGNUM(PADDR(boot_alloc(0)));
+
+	// In use:
+	//  1) Physical page 0, which holds the real-mode IDT and BIOS
+	//     structures in case we ever need them.
+	//  2) The IO hole [IOPHYSMEM, EXTPHYSMEM), then extended memory
+	//     holding the kernel and everything boot_alloc handed out.
+	//  3) Anything outside the usable ranges of the memory map.
+	// Everything else is freed page by page; neighbors coalesce into
+	// larger blocks as they go.
+	for (i = 0; i < npages; i++) {
+		if (i == 0 || (i >= npages_basemem && i < first_free)
+		    || !mem_usable(page2pa(&pages[i]))) {
+			pages[i].pp_ref = 1;
+			continue;
+		}
+		buddy_free(&pages[i]);
+	}
+}
+
+// Move up to 'n' pages between this CPU's cache and the buddy lists.
+// Drains take the coldest pages, at the bottom of the stack.
+static void
+page_cache_refill(struct PageCpu *pc, int n)
+{
+	struct PageInfo *pp;
+
+	pc->pc_refills++;
+	while (n-- > 0 && pc->pc_count < PAGE_CACHE_SIZE) {
+		if (!(pp = buddy_alloc(ZONE_LOW, 0)))
+			break;
+		pp->pp_flags |= PP_CACHED;
+		pc->pc_pages[pc->pc_count++] = pp;
+	}
+}
+
+static void
+page_cache_drain_n(struct PageCpu *pc, int n)
+{
+	int i;
+
+	n = MIN(n, pc->pc_count);
+	pc->pc_drains++;
+	for (i = 0; i < n; i++) {
+		pc->pc_pages[i]->pp_flags &= ~PP_CACHED;
+		buddy_free(pc->pc_pages[i]);
+	}
+	pc->pc_count -= n;
+	memmove(pc->pc_pages, pc->pc_pages + n,
+		pc->pc_count * sizeof(pc->pc_pages[0]));
+}
+
+//
+// Return every page in this CPU's cache and zeroed pool to the buddy
+// lists, e.g. so that they can coalesce into a larger block.
+//
+void
+page_cache_drain(void)
+{
+	struct PageCpu *pc = &page_cpus[cpunum()];
+	struct PageInfo *pp;
+
+	if (pc->pc_count)
+		page_cache_drain_n(pc, pc->pc_count);
+	while (pc->pc_nzero > 0) {
+		pp = pc->pc_zero[--pc->pc_nzero];
+		pp->pp_flags &= ~PP_CACHED;
+		buddy_free(pp);
+	}
+}
+
+// Zero a page with non-temporal stores, which bypass the caches: a
+// page zeroed ahead of time would otherwise evict useful lines, only
+// to be evicted itself before it is used.
+static void
+page_zero_nt(void *kva)
+{
+	uint32_t *p, *end = (uint32_t *) kva + PGSIZE / 4;
+
+	if (!page_movnti) {
+		memset(kva, 0, PGSIZE);
+		return;
+	}
+	for (p = kva; p < end; p += 4)
+		asm volatile("movnti %1, 0(%0)\n\t"
+			     "movnti %1, 4(%0)\n\t"
+			     "movnti %1, 8(%0)\n\t"
+			     "movnti %1, 12(%0)"
+			     : : "r" (p), "r" (0) : "memory");
+	// Order the weakly ordered stores before the page is handed out.
+	asm volatile("sfence" : : : "memory");
+}
+
+//
+// Zero one free page into this CPU's pool, unless the pool is full.
+// Meant for idle loops: each call is one page's worth of work.
+// Returns whether there was anything to do.
+//
+bool
+page_zero_idle(void)
+{
+	struct PageCpu *pc = &page_cpus[cpunum()];
+	struct PageInfo *pp;
+
+	if (pc->pc_nzero == PAGE_ZERO_POOL
+	    || !(pp = buddy_alloc(ZONE_LOW, 0)))
+		return 0;
+	page_zero_nt(page2kva(pp));
+	pp->pp_flags |= PP_CACHED;
+	pc->pc_zero[pc->pc_nzero++] = pp;
+	return 1;
+}
+
+// Zero a block, through kmap if it is in highmem.
+static void
+page_zero(struct PageInfo *pp, int order)
+{
+	void *kva;
+	int i;
+
+	if (!page_is_high(pp)) {
+		memset(page2kva(pp), 0, PGSIZE << order);
+		return;
+	}
+	for (i = 0; i < (1 << order); i++) {
+		kva = kmap(&pp[i]);
+		memset(kva, 0, PGSIZE);
+		kunmap(kva);
+	}
+}
+
+//
+// Allocates a naturally aligned block of 2^order physical pages.
+// If (alloc_flags & ALLOC_ZERO), fills the entire block with '\0'
+// bytes.  If (alloc_flags & ALLOC_HIGH), the block comes from highmem
+// while there is any free.  Does NOT increment the reference count of
+// the pages - the caller must do these if necessary (either explicitly
+// or via page_insert).
+//
+// Single lowmem pages come from this CPU's page cache, or, with
+// ALLOC_ZERO, from its zeroed pool while that lasts.
+//
+// Returns NULL if no block that large is free.
+//
+struct PageInfo *
+page_alloc_order(int order, int alloc_flags)
+{
+	struct PageCpu *pc = &page_cpus[cpunum()];
+	struct PageInfo *pp;
+
+	assert(order >= 0 && order <= PAGE_MAX_ORDER);
+
+	if ((alloc_flags & ALLOC_HIGH) && (pp = buddy_alloc(ZONE_HIGH, order)))
+		/* highmem bypasses the page cache */;
+	else if (order == 0 && (alloc_flags & ALLOC_ZERO) && pc->pc_nzero) {
+		pp = pc->pc_zero[--pc->pc_nzero];
+		pp->pp_flags &= ~PP_CACHED;
+		pc->pc_allocs++;
+		pc->pc_zero_hits++;
+		return pp;
+	} else if (order == 0) {
+		if (pc->pc_count == 0)
+			page_cache_refill(pc, PAGE_CACHE_BATCH);
+		if (pc->pc_count == 0 && pc->pc_nzero) {
+			// Nothing free but the zeroed pool.
+			page_cache_drain();
+			page_cache_refill(pc, PAGE_CACHE_BATCH);
+		}
+		if (pc->pc_count == 0)
+			return NULL;
+		if (alloc_flags & ALLOC_ZERO)
+			pc->pc_zero_misses++;
+		pp = pc->pc_pages[--pc->pc_count];
+		pp->pp_flags &= ~PP_CACHED;
+		pc->pc_allocs++;
+	} else if (!(pp = buddy_alloc(ZONE_LOW, order))) {
+		// Cached pages may be what keeps a block from merging.
+		page_cache_drain();
+		if (!(pp = buddy_alloc(ZONE_LOW, order)))
+			return NULL;
+	}
+
+	if (alloc_flags & ALLOC_ZERO)
+		page_zero(pp, order);
+	return pp;
+}
+
+//
+// Allocates a single physical page.
+//
+struct PageInfo *
+page_alloc(int alloc_flags)
+{
+	return page_alloc_order(0, alloc_flags);
+}
+
+//
+// Return a block allocated by page_alloc or page_alloc_order.  Single
+// lowmem pages go to this CPU's page cache, anything else straight
+// back to the buddy lists.
+// (This function should only be called when pp->pp_ref reaches 0.)
+//
+void
+page_free(struct PageInfo *pp)
+{
+	struct PageCpu *pc = &page_cpus[cpunum()];
+
+	if (pp->pp_ref != 0)
+		panic("page_free: page %08llx still referenced",
+		      (uint64_t) page2pa(pp));
+	if (pp->pp_flags & (PP_FREE | PP_CACHED))
+		panic("page_free: page %08llx already free",
+		      (uint64_t) page2pa(pp));
+
+	if (pp->pp_order != 0 || page_is_high(pp)) {
+		buddy_free(pp);
+		return;
+	}
+	if (pc->pc_count == PAGE_CACHE_SIZE)
+		page_cache_drain_n(pc, PAGE_CACHE_BATCH);
+	pp->pp_flags |= PP_CACHED;
+	pc->pc_pages[pc->pc_count++] = pp;
+	pc->pc_frees++;
+}
+
+//
+// Decrement the reference count on a page,
+// freeing it if there are no more refs.
+//
+void
+page_decref(struct PageInfo* pp)
+{
+	if (--pp->pp_ref == 0)
+		page_free(pp);
+}
+
+// Free pages, counting those in the per-CPU caches.
+static size_t
+page_free_count(void)
+{
+	size_t n = page_nfree[ZONE_LOW] + page_nfree[ZONE_HIGH];
+	int i;
+
+	for (i = 0; i < NCPU; i++)
+		n += page_cpus[i].pc_count + page_cpus[i].pc_nzero;
+	return n;
+}
+
+// Print the usable memory ranges, then free blocks per order in each
+// zone and, for each order, the share of the zone's free memory that
+// sits in smaller blocks and so can't satisfy a request of that order
+// (the unusable free space index).  Then each CPU's page cache.
+void
+page_stats(void)
+{
+	static const char *const zone_names[] = { "low", "high" };
+	size_t usable, nfree;
+	struct PageCpu *pc;
+	int i, z;
+
+	for (i = 0; i < mem_nranges; i++)
+		cprintf("memory [%08llx, %08llx)\n",
+			(uint64_t) mem_ranges[i].mr_start,
+			(uint64_t) mem_ranges[i].mr_end);
+	for (z = 0; z < PAGE_NZONES; z++) {
+		if (z == ZONE_HIGH && npages == npages_low)
+			break;
+		usable = nfree = page_nfree[z];
+		cprintf("zone %s\norder  block   free unusable\n",
+			zone_names[z]);
+		for (i = 0; i <= PAGE_MAX_ORDER; i++) {
+			cprintf("%5d %5uK %6u %7u%%\n", i, 4 << i,
+				page_free_blocks[z][i],
+				nfree ? (nfree - usable) * 100 / nfree : 0);
+			usable -= page_free_blocks[z][i] << i;
+		}
+	}
+	for (i = 0; i < NCPU; i++) {
+		pc = &page_cpus[i];
+		cprintf("cpu %d: %d cached, %u allocs, %u frees, "
+			"%u refills, %u drains\n", i, pc->pc_count,
+			pc->pc_allocs, pc->pc_frees,
+			pc->pc_refills, pc->pc_drains);
+		cprintf("cpu %d: %d zeroed, %u zeroed allocs from the pool, "
+			"%u zeroed on demand\n", i, pc->pc_nzero,
+			pc->pc_zero_hits, pc->pc_zero_misses);
+	}
+	cprintf("%u of %u pages free\n", page_free_count(), npages);
+}
+
+// Given 'pgdir', a pointer to a page directory, pgdir_walk returns
+// a pointer to the page table entry (PTE) for linear address 'va'.
+// This requires walking the two-level page table structure (with PAE,
+// the page directory pointer table is just the page directory's four
+// pages, which PDX already takes into account).
+//
+// The relevant page table page might not exist yet.
+// If this is true, and create == false, then pgdir_walk returns NULL.
+// Otherwise, pgdir_walk allocates a new page table page with page_alloc.
+//    - If the allocation fails, pgdir_walk returns NULL.
+//    - Otherwise, the new page's reference count is incremented,
+//	the page is cleared,
+//	and pgdir_walk returns a pointer into the new page table page.
+//
+// If 'va' is covered by a 4MB page, the page directory entry itself
+// is returned; the caller can tell by its PTE_PS bit.
+//
+// With create, the caller means to change the entry, so a page table
+// shared copy-on-write is first copied; if that fails, NULL is
+// returned as well.
+pte_t *
+pgdir_walk(pde_t *pgdir, const void *va, int create)
+{
+	pde_t *pde = &pgdir[PDX(va)];
+	struct PageInfo *pp;
+
+	if (!(*pde & PTE_P)) {
+		if (!create || !(pp = page_alloc(ALLOC_ZERO)))
+			return NULL;
+		pp->pp_ref++;
+		*pde = page2pa(pp) | PTE_P | PTE_W | PTE_U;
+	}
+	if (*pde & PTE_PS)
+		return (pte_t *) pde;
+	if (create && (*pde & PTE_COW) && pt_unshare(pde) < 0)
+		return NULL;
+	return (pte_t *) KADDR(PTE_ADDR(*pde)) + PTX(va);
+}
+
+//
+// Map [va, va+size) of virtual address space to physical [pa, pa+size)
+// in the page table rooted at pgdir.  Size is a multiple of PGSIZE, and
+// va and pa are both page-aligned.
+// Use permission bits perm|PTE_P for the entries.
+//
+// This function is only intended to set up the ``static'' mappings
+// above UTOP. As such, it should *not* change the pp_ref field on the
+// mapped pages.
+//
+static void
+boot_map_region(pde_t *pgdir, uintptr_t va, size_t size, physaddr_t pa, pte_t perm)
+{
+	size_t off;
+	pte_t *pte;
+
+	for (off = 0; off < size; off += PGSIZE) {
+		if (!(pte = pgdir_walk(pgdir, (void *) (va + off), 1)))
+			panic("boot_map_region: out of memory");
+		*pte = (pa + off) | perm | PTE_P;
+	}
+}
+
+//
+// Map the physical page 'pp' at virtual address 'va'.
+// The permissions (the low 12 bits) of the page table entry
+// should be set to 'perm|PTE_P'.
+//
+// Requirements
+//   - If there is already a page mapped at 'va', it should be page_remove()d.
+//   - If necessary, on demand, a page table should be allocated and inserted
+//     into 'pgdir'.
+//   - pp->pp_ref should be incremented if the insertion succeeds.
+//   - The TLB must be invalidated if a page was formerly present at 'va'.
+//
+// RETURNS:
+//   0 on success
+//   -E_NO_MEM, if page table couldn't be allocated
+//   -E_INVAL, if 'va' is covered by a 4MB page
+//
+int
+page_insert(pde_t *pgdir, struct PageInfo *pp, void *va, int perm)
+{
+	pte_t *pte;
+
+	if (!(pte = pgdir_walk(pgdir, va, 1)))
+		return -E_NO_MEM;
+	if (pgdir[PDX(va)] & PTE_PS)
+		return -E_INVAL;
+	// Take the new reference first, so that re-inserting the page
+	// already mapped at 'va' doesn't free it.
+	pp->pp_ref++;
+	if (*pte & PTE_P)
+		page_remove(pgdir, va);
+	*pte = page2pa(pp) | perm | PTE_P;
+	return 0;
+}
+
+//
+// Return the page mapped at virtual address 'va'.
+// If pte_store is not zero, then we store in it the address
+// of the pte for this page.  This is used by page_remove.
+//
+// Return NULL if there is no page mapped at va, or if va is covered
+// by a 4MB page, which has no struct PageInfo of its own to return.
+//
+struct PageInfo *
+page_lookup(pde_t *pgdir, void *va, pte_t **pte_store)
+{
+	pte_t *pte = pgdir_walk(pgdir, va, 0);
+
+	if (!pte || !(*pte & PTE_P) || (pgdir[PDX(va)] & PTE_PS))
+		return NULL;
+	if (pte_store)
+		*pte_store = pte;
+	return pa2page(PTE_ADDR(*pte));
+}
+
+//
+// Unmaps the physical page at virtual address 'va'.
+// If there is no physical page at that address, silently does nothing.
+//
+// Details:
+//   - The ref count on the physical page should decrement.
+//   - The physical page should be freed if the refcount reaches 0.
+//   - The pg table entry corresponding to 'va' should be set to 0.
+//     (if such a PTE exists)
+//   - The TLB must be invalidated if you remove an entry from
+//     the page table.
+//   - A 4MB page at 'va' is left alone (page_lookup doesn't find it).
+//
+void
+page_remove(pde_t *pgdir, void *va)
+{
+	pde_t *pde = &pgdir[PDX(va)];
+	struct PageInfo *pp;
+	pte_t *pte;
+	int r;
+
+	if (!(pp = page_lookup(pgdir, va, &pte)))
+		return;
+	// Don't clear the entry for the other users of a shared table.
+	if ((*pde & PTE_COW) && (r = pt_unshare(pde)) < 0)
+		panic("page_remove: %e", r);
+	pte = (pte_t *) KADDR(PTE_ADDR(*pde)) + PTX(va);
+	page_decref(pp);
+	*pte = 0;
+	tlb_invalidate(pgdir, va);
+}
+
+// Check one run for page_map_batch, then map it.  Each page table is
+// walked once, not once per page.
+static int
+page_map_range(pde_t *dst, pde_t *src, const struct PageMapRange *r)
+{
+	uintptr_t sva = r->pm_srcva, dva = r->pm_dstva;
+	pte_t *spte = NULL, *dpte = NULL;
+	struct PageInfo *pp;
+	size_t i;
+
+	if (PGOFF(sva) || PGOFF(dva) || sva >= UTOP || dva >= UTOP
+	    || r->pm_npages > (UTOP - MAX(sva, dva)) / PGSIZE)
+		return -E_INVAL;
+	if ((r->pm_perm & (PTE_U | PTE_P)) != (PTE_U | PTE_P)
+	    || (r->pm_perm & ~PTE_SYSCALL))
+		return -E_INVAL;
+
+	// Check the whole source first, so a bad run maps nothing.
+	for (i = 0; i < r->pm_npages; i++, sva += PGSIZE) {
+		if (i == 0 || PTX(sva) == 0)
+			spte = pgdir_walk(src, (void *) sva, 0);
+		else
+			spte++;
+		if (!spte || (*spte & (PTE_P | PTE_PS)) != PTE_P)
+			return -E_INVAL;
+		if ((r->pm_perm & PTE_W) && !(*spte & PTE_W))
+			return -E_INVAL;
+	}
+
+	sva = r->pm_srcva;
+	for (i = 0; i < r->pm_npages; i++, sva += PGSIZE, dva += PGSIZE) {
+		if (i == 0 || PTX(sva) == 0)
+			spte = pgdir_walk(src, (void *) sva, 0);
+		else
+			spte++;
+		if (i == 0 || PTX(dva) == 0) {
+			if (!(dpte = pgdir_walk(dst, (void *) dva, 1)))
+				return -E_NO_MEM;
+			if (dst[PDX(dva)] & PTE_PS)
+				return -E_INVAL;
+		} else
+			dpte++;
+		pp = pa2page(PTE_ADDR(*spte));
+		pp->pp_ref++;
+		if (*dpte & PTE_P)
+			page_remove(dst, (void *) dva);
+		*dpte = page2pa(pp) | r->pm_perm;
+	}
+	return 0;
+}
+
+//
+// Map each of the 'n' runs of pages described by 'ranges' from 'src'
+// into 'dst', as page_insert would page by page, and set each run's
+// pm_status.  A run fails as a whole with -E_INVAL if it is misaligned,
+// reaches UTOP, asks for bad permissions, or covers a page that isn't
+// mapped in 'src' (or isn't writable there, if PTE_W is asked for).
+// It fails part way with -E_INVAL if it reaches a 4MB page in 'dst'.
+// It fails part way with -E_NO_MEM if a page table couldn't be
+// allocated.  Later runs are still attempted.
+//
+// RETURNS:
+//   the number of runs that failed
+//
+int
+page_map_batch(pde_t *dst, pde_t *src, struct PageMapRange *ranges, int n)
+{
+	int i, nfailed = 0;
+
+	for (i = 0; i < n; i++)
+		if ((ranges[i].pm_status = page_map_range(dst, src,
+							  &ranges[i])) < 0)
+			nfailed++;
+	tlbflush();
+	return nfailed;
+}
+
+//
+// Invalidate a TLB entry, but only if the page tables being
+// edited are the ones currently in use by the processor.
+//
+void
+tlb_invalidate(pde_t *pgdir, void *va)
+{
+	// Flush the entry only if we're modifying the current address space.
+	// For now, there is only one address space, so always invalidate.
+	invlpg(va);
+}
+
+//
+// Return a kernel address for the page 'pp'.  A lowmem page is already
+// in the direct map; a highmem page is mapped into the next slot of
+// this CPU's kmap window.  Mappings must be undone with kunmap, most
+// recent first, and must not be held across anything that might
+// switch to another CPU.
+//
+void *
+kmap(struct PageInfo *pp)
+{
+	int cpu = cpunum();
+	uintptr_t va;
+
+	if (!page_is_high(pp))
+		return page2kva(pp);
+	if (kmap_depth[cpu] == KMAP_SLOTS)
+		panic("kmap: more than %d nested mappings", KMAP_SLOTS);
+	va = KMAPBASE + (cpu * KMAP_SLOTS + kmap_depth[cpu]++) * PGSIZE;
+	kmap_ptes[PTX(va)] = page2pa(pp) | PTE_W | PTE_P | pte_nx;
+	return (void *) va;
+}
+
+//
+// Undo the mapping kmap returned at 'kva'.  The entry is flushed here,
+// so a fresh slot never has a stale translation.
+//
+void
+kunmap(void *kva)
+{
+	int cpu = cpunum();
+	uintptr_t va = ROUNDDOWN((uintptr_t) kva, PGSIZE);
+
+	if (va >= KERNBASE)
+		return;
+	if (kmap_depth[cpu] == 0 || va != KMAPBASE
+	    + (cpu * KMAP_SLOTS + kmap_depth[cpu] - 1) * PGSIZE)
+		panic("kunmap: %p is not the latest kmap", kva);
+	kmap_ptes[PTX(va)] = 0;
+	invlpg((void *) va);
+	kmap_depth[cpu]--;
+}
+
+
+// --------------------------------------------------------------
+// Address spaces and copy-on-write.
+//
+// pgdir_fork shares the parent's page tables with the child instead
+// of copying them: both page directories point at the same tables,
+// write-protected and marked PTE_COW, with each table's pp_ref
+// counting the directories that use it.  The first write through a
+// shared table faults; page_cow_fault then gives the writer its own
+// copy of the table, turning every writable entry in both copies into
+// a PTE_COW entry and counting the extra reference to each page.  A
+// write to a PTE_COW page copies the page unless the writer holds the
+// last reference.  A child that exits without writing has cost one
+// reference per page table, whatever the size of the address space.
+// --------------------------------------------------------------
+
+//
+// Allocate an address space: an empty user half, with the kernel half
+// and UVPT as in kern_pgdir.  Returns NULL if out of memory.
+//
+pde_t *
+pgdir_create(void)
+{
+	struct PageInfo *pp;
+	pde_t *pgdir;
+
+	if (!(pp = page_alloc_order(PGDIR_ORDER, ALLOC_ZERO)))
+		return NULL;
+	pp->pp_ref++;
+	pgdir = page2kva(pp);
+	memcpy(&pgdir[PDX(UTOP)], &kern_pgdir[PDX(UTOP)],
+	       (NPDENTRIES - PDX(UTOP)) * sizeof(pde_t));
+	pgdir_map_uvpt(pgdir);
+	return pgdir;
+}
+
+// Map the page directory into itself at UVPT, one of its pages per
+// page directory entry, so that it serves as a page table there.
+static void
+pgdir_map_uvpt(pde_t *pgdir)
+{
+	int i;
+
+	for (i = 0; i < UVPTSIZE / PTSIZE; i++)
+		pgdir[PDX(UVPT) + i] =
+			(PADDR(pgdir) + i * PGSIZE) | PTE_U | PTE_P;
+}
+
+//
+// Switch this CPU to the address space 'pgdir'.  With PAE, this CPU's
+// page directory pointer table is pointed at the page directory's
+// four pages first; the CPU only reads it when %cr3 is loaded.
+//
+void
+pgdir_load(pde_t *pgdir)
+{
+#ifdef PAE
+	pde_t *pdpt = pgdir_pdpt[cpunum()];
+	int i;
+
+	for (i = 0; i < NPDPENTRIES; i++)
+		pdpt[i] = (PADDR(pgdir) + i * PGSIZE) | PTE_P;
+	lcr3(PADDR(pdpt));
+#else
+	lcr3(PADDR(pgdir));
+#endif
+}
+
+// Drop one address space's reference to the page table at 'pde',
+// freeing it and its pages' references with the last one.
+static void
+pt_decref(pde_t pde)
+{
+	struct PageInfo *ptp = pa2page(PTE_ADDR(pde));
+	pte_t *pt;
+	int i;
+
+	if (--ptp->pp_ref > 0)
+		return;
+	pt = page2kva(ptp);
+	for (i = 0; i < NPTENTRIES; i++)
+		if (pt[i] & PTE_P) {
+			page_decref(pa2page(PTE_ADDR(pt[i])));
+			pt[i] = 0;
+		}
+	page_free(ptp);
+}
+
+//
+// Free an address space made by pgdir_create, with its page tables and
+// its references to the pages they map.
+//
+void
+pgdir_destroy(pde_t *pgdir)
+{
+	int i;
+
+	if (pgdir == curpgdir())
+		pgdir_load(kern_pgdir);
+	for (i = 0; i < PDX(UTOP); i++)
+		if (pgdir[i] & PTE_P) {
+			pt_decref(pgdir[i]);
+			pgdir[i] = 0;
+		}
+	page_decref(pa2page(PADDR(pgdir)));
+}
+
+//
+// Make 'dst', fresh from pgdir_create, a copy-on-write copy of the user
+// half of 'src'.  This only shares page tables, so it cannot fail.
+//
+void
+pgdir_fork(pde_t *dst, pde_t *src)
+{
+	int i;
+
+	for (i = 0; i < PDX(UTOP); i++) {
+		if (!(src[i] & PTE_P))
+			continue;
+		if (src[i] & PTE_W)
+			src[i] = (src[i] & ~PTE_W) | PTE_COW;
+		dst[i] = src[i];
+		pa2page(PTE_ADDR(src[i]))->pp_ref++;
+	}
+	if (src == curpgdir())
+		tlbflush();
+}
+
+// Give 'pde', which points at a shared page table, a table of its own.
+// The entries it had that were writable become copy-on-write in both
+// tables, as their pages are now mapped twice.  Flushes the TLB, in
+// case 'pde' belongs to the current address space.
+static int
+pt_unshare(pde_t *pde)
+{
+	struct PageInfo *ptp = pa2page(PTE_ADDR(*pde)), *pp;
+	pte_t *pt = page2kva(ptp), *npt;
+	int i;
+
+	if (ptp->pp_ref == 1) {
+		// The others have gone; their copies took care of the entries.
+		*pde = (*pde & ~PTE_COW) | PTE_W;
+		tlbflush();
+		return 0;
+	}
+	if (!(pp = page_alloc(0)))
+		return -E_NO_MEM;
+	npt = page2kva(pp);
+	for (i = 0; i < NPTENTRIES; i++) {
+		if (pt[i] & PTE_W)
+			pt[i] = (pt[i] & ~PTE_W) | PTE_COW;
+		npt[i] = pt[i];
+		if (pt[i] & PTE_P)
+			pa2page(PTE_ADDR(pt[i]))->pp_ref++;
+	}
+	ptp->pp_ref--;
+	pp->pp_ref++;
+	*pde = page2pa(pp) | (PTE_FLAGS(*pde) & ~PTE_COW) | PTE_W;
+	tlbflush();
+	return 0;
+}
+
+//
+// Resolve a write fault at 'va' in 'pgdir' if it hit a copy-on-write
+// page table or page.  New pages come from highmem if there is any.
+//
+// RETURNS:
+//   0 if a copy-on-write page table or page was dealt with, so the
+//     write can be retried
+//   -E_FAULT, if neither the page nor the page table at 'va' is
+//     copy-on-write
+//   -E_NO_MEM, if a page or page table couldn't be allocated
+//
+int
+page_cow_fault(pde_t *pgdir, void *va)
+{
+	pde_t *pde = &pgdir[PDX(va)];
+	struct PageInfo *pp, *np;
+	bool shared_pt = 0;
+	void *src, *dst;
+	pte_t *pte;
+	int r;
+
+	if ((uintptr_t) va >= UTOP || (*pde & (PTE_P | PTE_PS)) != PTE_P)
+		return -E_FAULT;
+	if (*pde & PTE_COW) {
+		if ((r = pt_unshare(pde)) < 0)
+			return r;
+		shared_pt = 1;
+	}
+
+	// Unless it was the shared table that caused the fault, a page
+	// that isn't copy-on-write faulted for some other reason, such
+	// as a user write to a kernel page.  If it still faults once the
+	// table is unshared, the retry ends up here with shared_pt clear.
+	pte = (pte_t *) KADDR(PTE_ADDR(*pde)) + PTX(va);
+	if (!(*pte & PTE_COW))
+		return shared_pt ? 0 : -E_FAULT;
+	pp = pa2page(PTE_ADDR(*pte));
+	if (pp->pp_ref == 1) {
+		*pte = (*pte & ~PTE_COW) | PTE_W;
+	} else {
+		if (!(np = page_alloc(ALLOC_HIGH)))
+			return -E_NO_MEM;
+		src = kmap(pp);
+		dst = kmap(np);
+		memcpy(dst, src, PGSIZE);
+		kunmap(dst);
+		kunmap(src);
+		pp->pp_ref--;
+		np->pp_ref++;
+		*pte = page2pa(np) | (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+	}
+	tlb_invalidate(pgdir, va);
+	return 0;
+}
+
+
+// --------------------------------------------------------------
+// Checking functions.
+// --------------------------------------------------------------
+
+//
+// Check the buddy allocator: every order can be allocated, blocks are
+// naturally aligned and zeroed on request, and freeing them (and
+// draining the page cache) merges the free lists back into exactly
+// their previous shape.  Then check that the page cache hands back
+// the page freed last, and, given highmem, that it is reached through
+// kmap.
+//
+static void
+check_page_alloc(void)
+{
+	size_t blocks[PAGE_NZONES][PAGE_NORDERS], nfree;
+	struct PageInfo *pp, *pp0, *pp1;
+	uint32_t *p, *q;
+	int order;
+
+	page_cache_drain();
+	nfree = page_free_count();
+	memmove(blocks, page_free_blocks, sizeof(blocks));
+
+	for (order = 0; order <= PAGE_MAX_ORDER; order++) {
+		if (!(pp = page_alloc_order(order, ALLOC_ZERO)))
+			break;
+		assert(((pp - pages) & ((1 << order) - 1)) == 0);
+		assert(page_free_count() == nfree - (1 << order));
+		p = page2kva(pp);
+		assert(p[0] == 0 && p[(PGSIZE << order) / 4 - 1] == 0);
+		page_free(pp);
+		assert(page_free_count() == nfree);
+		page_cache_drain();
+		assert(memcmp(blocks, page_free_blocks, sizeof(blocks)) == 0);
+	}
+
+	pp0 = page_alloc(0);
+	pp1 = page_alloc(0);
+	assert(pp0 && pp1 && pp0 != pp1);
+	page_free(pp1);
+	assert(page_alloc(0) == pp1);
+	page_free(pp1);
+	page_free(pp0);
+	page_cache_drain();
+	assert(memcmp(blocks, page_free_blocks, sizeof(blocks)) == 0);
+
+	if (npages > npages_low) {
+		pp0 = page_alloc_order(1, ALLOC_HIGH | ALLOC_ZERO);
+		assert(pp0 && page_is_high(pp0));
+		p = kmap(&pp0[0]);
+		q = kmap(&pp0[1]);
+		assert((uintptr_t) p >= KMAPBASE && (uintptr_t) q < KSTACKTOP);
+		assert(p[0] == 0 && q[PGSIZE / 4 - 1] == 0);
+		p[0] = 0x12345678;
+		kunmap(q);
+		kunmap(p);
+		p = kmap(&pp0[0]);
+		assert(p[0] == 0x12345678);
+		kunmap(p);
+		page_free(pp0);
+		assert(memcmp(blocks, page_free_blocks, sizeof(blocks)) == 0);
+	}
+
+	cprintf("check_page_alloc() succeeded!\n");
+}
+
+//
+// Check copy-on-write forking.  A fork shares the parent's page table
+// and none of its pages; the parent's first write unshares the table,
+// leaving every page mapped copy-on-write by both, and copies the page
+// written.  A write by the child then gives it a private page of its
+// own, and the parent's stays as it was.  Destroying both address
+// spaces frees everything they used.
+//
+static void
+check_cow(void)
+{
+	struct PageInfo *pp[3], *ptp, *np;
+	pde_t *parent, *child;
+	char *va = (char *) UTEXT;
+	pte_t *pte, *cpte;
+	uint32_t *p;
+	size_t nfree;
+	int i;
+
+	nfree = page_free_count();
+	assert((parent = pgdir_create()) && (child = pgdir_create()));
+	for (i = 0; i < 3; i++) {
+		assert((pp[i] = page_alloc(ALLOC_HIGH | ALLOC_ZERO)));
+		assert(page_insert(parent, pp[i], va + i * PGSIZE,
+				   PTE_W | PTE_U) == 0);
+		p = kmap(pp[i]);
+		p[0] = i;
+		kunmap(p);
+	}
+
+	// The fork shares the page table, write-protected.
+	pgdir_fork(child, parent);
+	ptp = pa2page(PTE_ADDR(parent[PDX(va)]));
+	assert(child[PDX(va)] == parent[PDX(va)]);
+	assert((parent[PDX(va)] & (PTE_COW | PTE_W)) == PTE_COW);
+	assert(ptp->pp_ref == 2);
+	for (i = 0; i < 3; i++)
+		assert(pp[i]->pp_ref == 1);
+
+	// The parent writes page 0: it gets its own table and a copy of
+	// the page; the rest are copy-on-write in both tables.
+	assert(page_cow_fault(parent, va) == 0);
+	assert(PTE_ADDR(parent[PDX(va)]) != PTE_ADDR(child[PDX(va)]));
+	assert((parent[PDX(va)] & (PTE_COW | PTE_W)) == PTE_W);
+	assert(ptp->pp_ref == 1);
+	for (i = 1; i < 3; i++) {
+		assert(page_lookup(parent, va + i * PGSIZE, &pte) == pp[i]);
+		assert(page_lookup(child, va + i * PGSIZE, &cpte) == pp[i]);
+		assert((*pte & (PTE_COW | PTE_W)) == PTE_COW);
+		assert((*cpte & (PTE_COW | PTE_W)) == PTE_COW);
+		assert(pp[i]->pp_ref == 2);
+	}
+	assert((np = page_lookup(parent, va, &pte)) && np != pp[0]);
+	assert((*pte & (PTE_COW | PTE_W)) == PTE_W);
+	assert(page_lookup(child, va, NULL) == pp[0] && pp[0]->pp_ref == 1);
+	p = kmap(np);
+	assert(p[0] == 0);
+	p[0] = 0xdead;
+	kunmap(p);
+
+	// The child writes page 1 and gets a private copy of it.
+	assert(page_cow_fault(child, va + PGSIZE) == 0);
+	assert((np = page_lookup(child, va + PGSIZE, &cpte)) && np != pp[1]);
+	assert((*cpte & (PTE_COW | PTE_W)) == PTE_W);
+	assert(pp[1]->pp_ref == 1 && np->pp_ref == 1);
+	p = kmap(np);
+	assert(p[0] == 1);
+	p[0] = 0xbeef;
+	kunmap(p);
+	p = kmap(pp[1]);
+	assert(p[0] == 1);
+	kunmap(p);
+	p = kmap(page_lookup(parent, va, NULL));
+	assert(p[0] == 0xdead);
+	kunmap(p);
+
+	// Page 0 is now the child's alone, so its write needs no copy.
+	assert(page_cow_fault(child, va) == 0);
+	assert(page_lookup(child, va, &cpte) == pp[0]);
+	assert((*cpte & (PTE_COW | PTE_W)) == PTE_W);
+
+	pgdir_destroy(child);
+	pgdir_destroy(parent);
+	assert(page_free_count() == nfree);
+
+	cprintf("check_cow() succeeded!\n");
+}
@@ -0,0 +1,157 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_PMAP_H
+#define JOS_KERN_PMAP_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/memlayout.h>
+#include <inc/assert.h>
+#include <inc/cache.h>
+#include <inc/x86.h>
+
+extern char bootstacktop[], bootstack[];
+
+extern struct PageInfo *pages;
+extern size_t npages;
+extern size_t npages_low;	// pages in the direct map; the rest are highmem
+
+extern pde_t *kern_pgdir;
+
+// The physical allocator hands out naturally aligned blocks of
+// 2^order pages, order 0 through PAGE_MAX_ORDER (4MB).
+#define PAGE_MAX_ORDER	10
+#define PAGE_NORDERS	(PAGE_MAX_ORDER + 1)
+
+// Single pages are allocated and freed through a per-CPU cache, which
+// moves pages to and from the shared buddy lists in batches.
+#define PAGE_CACHE_SIZE		64	// pages a CPU may hold
+#define PAGE_CACHE_BATCH	16	// pages per refill or drain
+
+// Each CPU also keeps a pool of pages zeroed ahead of time, while it
+// has nothing else to do, for single-page ALLOC_ZERO requests.
+#define PAGE_ZERO_POOL		32	// pre-zeroed pages a CPU may hold
+
+struct PageCpu {
+	int pc_count;
+	struct PageInfo *pc_pages[PAGE_CACHE_SIZE];	// LIFO: top is hot
+	uint32_t pc_allocs;	// single-page allocations on this CPU
+	uint32_t pc_frees;
+	uint32_t pc_refills;	// batches taken from the buddy lists
+	uint32_t pc_drains;	// batches given back
+	int pc_nzero;
+	struct PageInfo *pc_zero[PAGE_ZERO_POOL];
+	uint32_t pc_zero_hits;	// ALLOC_ZERO pages taken from the pool
+	uint32_t pc_zero_misses; // ALLOC_ZERO pages zeroed on the spot
+} ____cacheline_aligned;
+
+
+/* This macro takes a kernel virtual address -- an address that points above
+ * KERNBASE, where the first 256MB of physical memory is mapped --
+ * and returns the corresponding physical address.  It panics if you pass it a
+ * non-kernel virtual address.
+ */
+#define PADDR(kva) _paddr(__FILE__, __LINE__, kva)
+
+static inline physaddr_t
+_paddr(const char *file, int line, void *kva)
+{
+	if ((uint32_t)kva < KERNBASE)
+		_panic(file, line, "PADDR called with invalid kva %08lx", kva);
+	return (uint32_t)kva - KERNBASE;
+}
+
+/* This macro takes a physical address and returns the corresponding kernel
+ * virtual address.  It panics if you pass an invalid physical address,
+ * including one in highmem, which has no permanent kernel address. */
+#define KADDR(pa) _kaddr(__FILE__, __LINE__, pa)
+
+static inline void*
+_kaddr(const char *file, int line, physaddr_t pa)
+{
+	if ((pa >> PGSHIFT) >= npages_low)
+		_panic(file, line, "KADDR called with invalid pa %08llx",
+		       (uint64_t) pa);
+	return (void *)((uint32_t) pa + KERNBASE);
+}
+
+
+enum {
+	// For page_alloc, zero the returned physical page.
+	ALLOC_ZERO = 1<<0,
+	// For page_alloc, prefer a highmem page: the caller reaches it
+	// through its own mappings or kmap, never through page2kva.
+	ALLOC_HIGH = 1<<1,
+};
+
+void	mem_init(void);
+
+void	page_init(void);
+struct PageInfo *page_alloc(int alloc_flags);
+struct PageInfo *page_alloc_order(int order, int alloc_flags);
+void	page_free(struct PageInfo *pp);
+void	page_cache_drain(void);
+bool	page_zero_idle(void);
+int	page_insert(pde_t *pgdir, struct PageInfo *pp, void *va, int perm);
+int	page_map_batch(pde_t *dst, pde_t *src, struct PageMapRange *ranges,
+		       int n);
+void	page_remove(pde_t *pgdir, void *va);
+struct PageInfo *page_lookup(pde_t *pgdir, void *va, pte_t **pte_store);
+void	page_decref(struct PageInfo *pp);
+
+void	tlb_invalidate(pde_t *pgdir, void *va);
+
+pte_t	*pgdir_walk(pde_t *pgdir, const void *va, int create);
+
+pde_t	*pgdir_create(void);
+void	pgdir_load(pde_t *pgdir);
+void	pgdir_destroy(pde_t *pgdir);
+void	pgdir_fork(pde_t *dst, pde_t *src);
+int	page_cow_fault(pde_t *pgdir, void *va);
+
+void	page_stats(void);
+
+void	*kmap(struct PageInfo *pp);
+void	kunmap(void *kva);
+
+static inline physaddr_t
+page2pa(struct PageInfo *pp)
+{
+	return (physaddr_t) (pp - pages) << PGSHIFT;
+}
+
+static inline struct PageInfo*
+pa2page(physaddr_t pa)
+{
+	if ((pa >> PGSHIFT) >= npages)
+		panic("pa2page called with invalid pa");
+	return &pages[pa >> PGSHIFT];
+}
+
+static inline bool
+page_is_high(struct PageInfo *pp)
+{
+	return (size_t) (pp - pages) >= npages_low;
+}
+
+static inline void*
+page2kva(struct PageInfo *pp)
+{
+	return KADDR(page2pa(pp));
+}
+
+// The page directory of the current address space.  With PAE, %cr3
+// holds a page directory pointer table, whose first entry points at
+// the page directory's first page.
+static inline pde_t*
+curpgdir(void)
+{
+#ifdef PAE
+	return KADDR(PTE_ADDR(*(pde_t *) KADDR(rcr3())));
+#else
+	return KADDR(rcr3());
+#endif
+}
+
+#endif /* !JOS_KERN_PMAP_H */
@@ -0,0 +1,134 @@
+// Hardware performance counters.
+//
+// pmc_init() detects the architectural PMU through CPUID leaf 0xA.
+// pmc_start() programs up to PMC_MAXCOUNTERS general-purpose counters
+// and pmc_report() prints how far each has moved, read with rdpmc.
+// Without a PMU (QEMU without KVM, for example) only the TSC is
+// reported, so callers need not care which case they are in.
+
+#include <inc/stdio.h>
+#include <inc/x86.h>
+#include <inc/mmu.h>
+
+#include <kern/pmc.h>
+
+struct PmcEvent {
+	const char *name;
+	uint8_t event;
+	uint8_t umask;
+	int cpuid_bit;	// CPUID.0AH:EBX bit reporting it absent, or -1
+};
+
+// Event sets, counted one event per general-purpose counter.
+static const struct PmcEvent pmc_events[PMC_NSETS][PMC_MAXCOUNTERS] = {
+	[PMC_SET_DEFAULT] = {
+		{ "instructions", 0xC0, 0x00, 1 },
+		{ "llc-misses", 0x2E, 0x41, 4 },
+		{ "branch-misses", 0xC5, 0x00, 6 },
+		// Not architectural: DTLB_LOAD_MISSES.MISS_CAUSES_A_WALK
+		// on Nehalem and later Intel cores.
+		{ "dtlb-load-misses", 0x08, 0x01, -1 },
+	},
+	// For judging code layout, such as kern/hot.list.
+	[PMC_SET_FRONTEND] = {
+		{ "instructions", 0xC0, 0x00, 1 },
+		{ "core-cycles", 0x3C, 0x00, 0 },
+		// Not architectural: ICACHE.MISSES and
+		// ITLB_MISSES.MISS_CAUSES_A_WALK, Nehalem through Broadwell.
+		{ "icache-misses", 0x80, 0x02, -1 },
+		{ "itlb-misses", 0x85, 0x01, -1 },
+	},
+};
+
+static int pmc_version;
+static int pmc_ncounters;
+static int pmc_width;		// counter width in bits
+static uint64_t pmc_mask;
+static uint32_t pmc_absent;	// CPUID.0AH:EBX
+
+static int pmc_set;
+static uint64_t pmc_tsc0;
+static uint64_t pmc_base[PMC_MAXCOUNTERS];
+
+void
+pmc_init(void)
+{
+	uint32_t maxleaf, eax;
+
+	cpuid(0, &maxleaf, NULL, NULL, NULL);
+	if (maxleaf < 0xA)
+		return;
+	cpuid(0xA, &eax, &pmc_absent, NULL, NULL);
+	pmc_version = eax & 0xFF;
+	if (pmc_version == 0)
+		return;
+	pmc_ncounters = MIN((int) (eax >> 8) & 0xFF, PMC_MAXCOUNTERS);
+	pmc_width = (eax >> 16) & 0xFF;
+	pmc_mask = (1ULL << pmc_width) - 1;
+
+	// Allow rdpmc outside ring 0 too.
+	lcr4(rcr4() | CR4_PCE);
+}
+
+void
+pmc_info(void)
+{
+	if (pmc_version == 0) {
+		cprintf("pmc: no architectural PMU, counting TSC only\n");
+		return;
+	}
+	cprintf("pmc: PMU version %d, %d counters used, %d bits wide\n",
+		pmc_version, pmc_ncounters, pmc_width);
+}
+
+static bool
+pmc_usable(int i)
+{
+	int bit = pmc_events[pmc_set][i].cpuid_bit;
+
+	return i < pmc_ncounters && (bit < 0 || !(pmc_absent & (1 << bit)));
+}
+
+void
+pmc_start(int set)
+{
+	const struct PmcEvent *ev = pmc_events[set];
+	uint64_t enable = 0;
+	int i;
+
+	pmc_set = set;
+	for (i = 0; i < pmc_ncounters; i++) {
+		wrmsr(MSR_PERFEVTSEL0 + i, 0);
+		if (!pmc_usable(i))
+			continue;
+		wrmsr(MSR_PERFEVTSEL0 + i,
+		      ev[i].event | (ev[i].umask << 8)
+		      | PERFEVTSEL_OS | PERFEVTSEL_USR | PERFEVTSEL_EN);
+		enable |= 1 << i;
+	}
+	if (pmc_version >= 2)
+		wrmsr(MSR_PERF_GLOBAL_CTRL, enable);
+
+	for (i = 0; i < pmc_ncounters; i++)
+		pmc_base[i] = rdpmc(i);
+	pmc_tsc0 = read_tsc();
+}
+
+// Print "pmc <event> <delta>" for every counter since pmc_start().
+void
+pmc_report(void)
+{
+	uint64_t tsc = read_tsc(), now[PMC_MAXCOUNTERS];
+	int i;
+
+	for (i = 0; i < pmc_ncounters; i++)
+		now[i] = rdpmc(i);
+
+	cprintf("pmc tsc-cycles %llu\n", tsc - pmc_tsc0);
+	for (i = 0; i < pmc_ncounters; i++) {
+		if (!pmc_usable(i))
+			continue;
+		cprintf("pmc %s %llu\n", pmc_events[pmc_set][i].name,
+			(now[i] - pmc_base[i]) & pmc_mask);
+	}
+}
@@ -0,0 +1,30 @@
+#ifndef JOS_KERN_PMC_H
+#define JOS_KERN_PMC_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// Architectural performance monitoring MSRs (Intel SDM vol. 3, ch. 18)
+#define MSR_PERFEVTSEL0		0x186	// event select for counter 0
+#define MSR_PMC0		0x0C1	// general-purpose counter 0
+#define MSR_PERF_GLOBAL_CTRL	0x38F	// counter enables (version 2+)
+
+#define PERFEVTSEL_USR		(1 << 16)	// count at CPL > 0
+#define PERFEVTSEL_OS		(1 << 17)	// count at CPL 0
+#define PERFEVTSEL_EN		(1 << 22)	// enable counter
+
+#define PMC_MAXCOUNTERS		4	// general-purpose counters we program
+
+// Event sets for pmc_start()
+#define PMC_SET_DEFAULT		0	// instructions, LLC/branch/DTLB misses
+#define PMC_SET_FRONTEND	1	// instructions, cycles, i-cache/iTLB misses
+#define PMC_NSETS		2
+
+void pmc_init(void);
+void pmc_info(void);
+void pmc_start(int set);
+void pmc_report(void);
+
+#endif	// !JOS_KERN_PMC_H
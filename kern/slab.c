@@ -0,0 +1,337 @@
+// Slab allocator for fixed-size kernel objects, after Bonwick's
+// "The Slab Allocator: An Object-Caching Kernel Memory Allocator".
+//
+// A slab is a naturally aligned block from the page allocator.  It
+// starts with a struct Slab and a stack of free object indices; the
+// objects follow, from a per-slab "color" offset that steps by a cache
+// line from one slab to the next, so the first objects of different
+// slabs don't all compete for the same cache sets.  Every page of a
+// slab is marked PP_SLAB and points to the slab's first page, so any
+// object's slab can be found from its address alone.
+//
+// The free list lives in the header rather than in the free objects,
+// so objects keep their constructed state between uses.
+
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+
+#include <kern/slab.h>
+#include <kern/pmap.h>
+
+struct Slab {
+	struct Slab *sl_next;		// on its cache's partial/full/empty list
+	struct Slab *sl_prev;
+	struct KmemCache *sl_cache;
+	char *sl_base;			// first object, after the color offset
+	int sl_nfree;
+	uint16_t sl_free[];		// free object indices; top is next
+};
+
+// The cache of caches, which kmem_cache_create allocates from.
+static struct KmemCache kmem_cache_cache;
+static struct KmemCache *kmem_caches;
+
+static void
+slab_list_push(struct Slab **head, struct Slab *sl)
+{
+	sl->sl_prev = NULL;
+	sl->sl_next = *head;
+	if (*head)
+		(*head)->sl_prev = sl;
+	*head = sl;
+}
+
+static void
+slab_list_remove(struct Slab **head, struct Slab *sl)
+{
+	if (sl->sl_prev)
+		sl->sl_prev->sl_next = sl->sl_next;
+	else
+		*head = sl->sl_next;
+	if (sl->sl_next)
+		sl->sl_next->sl_prev = sl->sl_prev;
+	sl->sl_next = sl->sl_prev = NULL;
+}
+
+// Objects of 'size' bytes that fit in a slab of the given order;
+// the header size goes in *hdr.
+static int
+slab_fit(size_t size, size_t align, int order, size_t *hdr)
+{
+	size_t slab = PGSIZE << order;
+	int objs;
+
+	objs = (slab - sizeof(struct Slab)) / (size + sizeof(uint16_t));
+	for (; objs > 0; objs--) {
+		*hdr = ROUNDUP(sizeof(struct Slab) + objs * sizeof(uint16_t),
+			       align);
+		if (*hdr + objs * size <= slab)
+			break;
+	}
+	return objs;
+}
+
+// Fill in a cache's geometry, picking the smallest slab order that
+// wastes at most an eighth of the slab.
+static void
+kmem_cache_setup(struct KmemCache *kc, const char *name, size_t size,
+		 size_t align, void (*ctor)(void *obj))
+{
+	size_t hdr, slab;
+	int order, objs;
+
+	align = MAX(align, sizeof(void *));
+	assert((align & (align - 1)) == 0);
+	size = ROUNDUP(size, align);
+
+	for (order = 0; order <= KMEM_MAX_ORDER; order++) {
+		slab = PGSIZE << order;
+		objs = slab_fit(size, align, order, &hdr);
+		if (objs > 0 && (slab - hdr - objs * size) * 8 <= slab)
+			break;
+	}
+	if (order > KMEM_MAX_ORDER) {
+		order = KMEM_MAX_ORDER;
+		slab = PGSIZE << order;
+		if ((objs = slab_fit(size, align, order, &hdr)) == 0)
+			panic("kmem_cache_create: %s: %u-byte objects too large",
+			      name, size);
+	}
+
+	memset(kc, 0, sizeof(*kc));
+	kc->kc_name = name;
+	kc->kc_size = size;
+	kc->kc_align = align;
+	kc->kc_ctor = ctor;
+	kc->kc_order = order;
+	kc->kc_objs = objs;
+	kc->kc_hdr = hdr;
+	kc->kc_colors = (slab - hdr - objs * size) / MAX(align, CACHELINE) + 1;
+}
+
+// Add a slab to the cache's empty list.
+static struct Slab *
+slab_grow(struct KmemCache *kc)
+{
+	struct PageInfo *pp;
+	struct Slab *sl;
+	int i;
+
+	if (!(pp = page_alloc_order(kc->kc_order, 0)))
+		return NULL;
+	for (i = 0; i < (1 << kc->kc_order); i++) {
+		pp[i].pp_flags |= PP_SLAB;
+		pp[i].pp_link = pp;
+	}
+
+	sl = page2kva(pp);
+	sl->sl_cache = kc;
+	sl->sl_base = (char *) sl + kc->kc_hdr
+		+ kc->kc_next_color * MAX(kc->kc_align, CACHELINE);
+	kc->kc_next_color = (kc->kc_next_color + 1) % kc->kc_colors;
+
+	// Hand objects out in address order.
+	sl->sl_nfree = kc->kc_objs;
+	for (i = 0; i < kc->kc_objs; i++) {
+		sl->sl_free[i] = kc->kc_objs - 1 - i;
+		if (kc->kc_ctor)
+			kc->kc_ctor(sl->sl_base + i * kc->kc_size);
+	}
+
+	kc->kc_nslabs++;
+	slab_list_push(&kc->kc_empty, sl);
+	return sl;
+}
+
+static void
+slab_release(struct KmemCache *kc, struct Slab *sl)
+{
+	struct PageInfo *pp = pa2page(PADDR(sl));
+	int i;
+
+	for (i = 0; i < (1 << kc->kc_order); i++) {
+		pp[i].pp_flags &= ~PP_SLAB;
+		pp[i].pp_link = NULL;
+	}
+	kc->kc_nslabs--;
+	page_free(pp);
+}
+
+static struct Slab *
+slab_of(void *obj)
+{
+	struct PageInfo *pp = pa2page(PADDR(obj));
+
+	if (!(pp->pp_flags & PP_SLAB))
+		return NULL;
+	return page2kva(pp->pp_link);
+}
+
+// Take one object from the cache's slabs, preferring partly used
+// slabs so that empty ones can be given back.
+static void *
+slab_alloc_obj(struct KmemCache *kc)
+{
+	struct Slab *sl;
+	void *obj;
+
+	if (!(sl = kc->kc_partial)) {
+		if (!(sl = kc->kc_empty) && !(sl = slab_grow(kc)))
+			return NULL;
+		slab_list_remove(&kc->kc_empty, sl);
+		slab_list_push(&kc->kc_partial, sl);
+	}
+
+	obj = sl->sl_base + sl->sl_free[--sl->sl_nfree] * kc->kc_size;
+	if (sl->sl_nfree == 0) {
+		slab_list_remove(&kc->kc_partial, sl);
+		slab_list_push(&kc->kc_full, sl);
+	}
+	kc->kc_inuse++;
+	return obj;
+}
+
+// Return an object to its slab.  One empty slab is kept for the next
+// burst of allocations; any other is given back to the page allocator.
+static void
+slab_free_obj(struct KmemCache *kc, void *obj)
+{
+	struct Slab *sl = slab_of(obj);
+
+	if (sl->sl_nfree == 0) {
+		slab_list_remove(&kc->kc_full, sl);
+		slab_list_push(&kc->kc_partial, sl);
+	}
+	sl->sl_free[sl->sl_nfree++] = ((char *) obj - sl->sl_base) / kc->kc_size;
+	kc->kc_inuse--;
+
+	if (sl->sl_nfree == kc->kc_objs) {
+		slab_list_remove(&kc->kc_partial, sl);
+		if (kc->kc_empty)
+			slab_release(kc, sl);
+		else
+			slab_list_push(&kc->kc_empty, sl);
+	}
+}
+
+static void
+kmem_cache_link(struct KmemCache *kc)
+{
+	struct KmemCache **p;
+
+	for (p = &kmem_caches; *p; p = &(*p)->kc_next)
+		/* do nothing */;
+	*p = kc;
+}
+
+void
+slab_init(void)
+{
+	kmem_cache_setup(&kmem_cache_cache, "kmem_cache",
+			 sizeof(struct KmemCache), CACHELINE, NULL);
+	kmem_cache_link(&kmem_cache_cache);
+}
+
+//
+// Create a cache of 'size'-byte objects aligned to 'align' (0 for
+// pointer alignment).  If 'ctor' is not NULL it is called on every
+// object when its slab is created.
+// Returns NULL if out of memory.
+//
+struct KmemCache *
+kmem_cache_create(const char *name, size_t size, size_t align,
+		  void (*ctor)(void *obj))
+{
+	struct KmemCache *kc;
+
+	if (!(kc = kmem_cache_alloc(&kmem_cache_cache)))
+		return NULL;
+	kmem_cache_setup(kc, name, size, align, ctor);
+	kmem_cache_link(kc);
+	return kc;
+}
+
+//
+// Allocate an object, from this CPU's free stack if it has one.
+// An empty stack is refilled halfway from the slabs, leaving room for
+// frees.  Returns NULL if out of memory.
+//
+void *
+kmem_cache_alloc(struct KmemCache *kc)
+{
+	struct KmemMagazine *mg = &kc->kc_mags[cpunum()];
+	void *obj;
+
+	if (mg->mg_count == 0)
+		while (mg->mg_count < KMEM_MAG_SIZE / 2
+		       && (obj = slab_alloc_obj(kc)))
+			mg->mg_objs[mg->mg_count++] = obj;
+	if (mg->mg_count == 0)
+		return NULL;
+	mg->mg_allocs++;
+	return mg->mg_objs[--mg->mg_count];
+}
+
+//
+// Free an object to this CPU's free stack.  A full stack first gives
+// its colder half back to the slabs.
+//
+void
+kmem_cache_free(struct KmemCache *kc, void *obj)
+{
+	struct KmemMagazine *mg = &kc->kc_mags[cpunum()];
+	int i;
+
+	if (kmem_cache_of(obj) != kc)
+		panic("kmem_cache_free: %p is not from cache %s",
+		      obj, kc->kc_name);
+
+	if (mg->mg_count == KMEM_MAG_SIZE) {
+		for (i = 0; i < KMEM_MAG_SIZE / 2; i++)
+			slab_free_obj(kc, mg->mg_objs[i]);
+		mg->mg_count -= KMEM_MAG_SIZE / 2;
+		memmove(mg->mg_objs, mg->mg_objs + KMEM_MAG_SIZE / 2,
+			mg->mg_count * sizeof(mg->mg_objs[0]));
+	}
+	mg->mg_objs[mg->mg_count++] = obj;
+	mg->mg_frees++;
+}
+
+//
+// Return the cache that 'obj' was allocated from, or NULL if it is
+// not slab memory.
+//
+struct KmemCache *
+kmem_cache_of(void *obj)
+{
+	struct Slab *sl = slab_of(obj);
+
+	return sl ? sl->sl_cache : NULL;
+}
+
+//
+// Print one line per cache: object size, slab geometry, and objects
+// handed out versus objects in slabs.
+//
+void
+slab_info(void)
+{
+	struct KmemCache *kc;
+	uint32_t active, allocs;
+	int i;
+
+	cprintf("cache              size objs order slabs   active    total"
+		"   allocs\n");
+	for (kc = kmem_caches; kc; kc = kc->kc_next) {
+		active = kc->kc_inuse;
+		allocs = 0;
+		for (i = 0; i < NCPU; i++) {
+			active -= kc->kc_mags[i].mg_count;
+			allocs += kc->kc_mags[i].mg_allocs;
+		}
+		cprintf("%-16s %6u %4d %5d %5u %8u %8u %8u\n", kc->kc_name,
+			kc->kc_size, kc->kc_objs, kc->kc_order, kc->kc_nslabs,
+			active, kc->kc_nslabs * kc->kc_objs, allocs);
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef JOS_KERN_SLAB_H
+#define JOS_KERN_SLAB_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/cache.h>
+
+#include <kern/cpu.h>
+
+#define KMEM_MAG_SIZE	16	// objects per per-CPU free stack
+#define KMEM_MAX_ORDER	3	// largest slab: 8 pages
+
+// Per-CPU stack of free objects, in front of a cache's slabs.
+struct KmemMagazine {
+	int mg_count;
+	void *mg_objs[KMEM_MAG_SIZE];	// LIFO: top is hot
+	uint32_t mg_allocs;
+	uint32_t mg_frees;
+} ____cacheline_aligned;
+
+// An object cache: a set of slabs, each a block of 2^kc_order pages
+// carved into equal objects.  Objects are constructed once, when their
+// slab is created, and are expected to be returned to the cache in
+// their constructed state.
+struct KmemCache {
+	struct KmemMagazine kc_mags[NCPU];
+
+	const char *kc_name;
+	size_t kc_size;			// object size, multiple of kc_align
+	size_t kc_align;
+	void (*kc_ctor)(void *obj);	// may be NULL
+
+	int kc_order;			// slab size is PGSIZE << kc_order
+	int kc_objs;			// objects per slab
+	size_t kc_hdr;			// slab header bytes, with freelist
+	int kc_colors;			// distinct first-object offsets
+	int kc_next_color;
+
+	struct Slab *kc_partial;	// some objects free
+	struct Slab *kc_full;		// no objects free
+	struct Slab *kc_empty;		// all objects free
+	uint32_t kc_nslabs;
+	uint32_t kc_inuse;		// objects out of slabs, including
+					//  those in the per-CPU stacks
+
+	struct KmemCache *kc_next;	// all caches, for slabinfo
+};
+
+void slab_init(void);
+struct KmemCache *kmem_cache_create(const char *name, size_t size,
+				    size_t align, void (*ctor)(void *obj));
+void *kmem_cache_alloc(struct KmemCache *kc);
+void kmem_cache_free(struct KmemCache *kc, void *obj);
+struct KmemCache *kmem_cache_of(void *obj);
+void slab_info(void);
+
+#endif	// !JOS_KERN_SLAB_H
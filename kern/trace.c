@@ -0,0 +1,79 @@
+// Per-CPU tracepoint event rings, exported in Chrome trace-event JSON
+// (load the output in chrome://tracing or Perfetto).
+
+#include <inc/stdio.h>
+#include <inc/x86.h>
+
+#include <kern/trace.h>
+#include <kern/cpu.h>
+#include <kern/kclock.h>
+
+// Tracing starts enabled so boot is captured; 'trace off' stops it.
+bool trace_enabled __read_mostly = 1;
+
+static struct TraceRing trace_rings[NCPU];
+
+void
+trace_record(const char *name, uint32_t a, uint32_t b, int phase)
+{
+	struct TraceRing *tr = &trace_rings[cpunum()];
+	struct TraceEvent *te;
+	uint32_t slot = 1;
+
+	// Claim a slot with one instruction, so an interrupt handler
+	// tracing on this CPU in the middle of this function gets its own.
+	// No lock prefix: other CPUs never touch this ring.
+	asm volatile("xaddl %0, %1" : "+r" (slot), "+m" (tr->tr_head));
+
+	te = &tr->tr_events[slot & (TRACE_NEVENTS - 1)];
+	te->te_tsc = read_tsc();
+	te->te_name = name;
+	te->te_a = a;
+	te->te_b = b;
+	te->te_phase = phase;
+}
+
+void
+trace_clear(void)
+{
+	int i;
+
+	for (i = 0; i < NCPU; i++)
+		trace_rings[i].tr_head = 0;
+}
+
+// Print every buffered event as Chrome trace-event JSON.  Each CPU
+// shows up as one thread; timestamps are microseconds.
+void
+trace_dump(void)
+{
+	bool was_enabled = trace_enabled;
+	struct TraceRing *tr;
+	struct TraceEvent *te;
+	uint64_t ns;
+	uint32_t i, start;
+	char phase[2] = { 0, 0 };
+	int cpu, first = 1;
+
+	trace_enabled = 0;
+	cprintf("{\"traceEvents\":[\n");
+	for (cpu = 0; cpu < NCPU; cpu++) {
+		tr = &trace_rings[cpu];
+		start = tr->tr_head > TRACE_NEVENTS
+			? tr->tr_head - TRACE_NEVENTS : 0;
+		for (i = start; i != tr->tr_head; i++) {
+			te = &tr->tr_events[i & (TRACE_NEVENTS - 1)];
+			ns = cycles_to_ns(te->te_tsc);
+			phase[0] = te->te_phase;
+			cprintf("%s{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%llu.%03u,"
+				"\"pid\":0,\"tid\":%d,\"s\":\"t\","
+				"\"args\":{\"a\":%u,\"b\":%u}}",
+				first ? "" : ",\n", te->te_name, phase,
+				ns / 1000, (uint32_t) (ns % 1000), cpu,
+				te->te_a, te->te_b);
+			first = 0;
+		}
+	}
+	cprintf("\n]}\n");
+	trace_enabled = was_enabled;
+}
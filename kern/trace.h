@@ -0,0 +1,55 @@
+#ifndef JOS_KERN_TRACE_H
+#define JOS_KERN_TRACE_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/cache.h>
+
+// Static tracepoints.
+//
+// TRACE_EVENT(name, a, b) appends a timestamped record to the current
+// CPU's event ring.  'name' must be a string with static storage (it is
+// recorded by pointer); 'a' and 'b' are arbitrary 32-bit arguments.
+// TRACE_BEGIN/TRACE_END mark the two ends of a duration.  While tracing
+// is off each tracepoint costs one predicted-not-taken branch.
+
+#define TRACE_NEVENTS	1024	// events per CPU ring; a power of two
+
+#define TRACE_PH_INSTANT 'i'	// phases, as in the Chrome trace format
+#define TRACE_PH_BEGIN	'B'
+#define TRACE_PH_END	'E'
+
+struct TraceEvent {
+	uint64_t te_tsc;	// read_tsc() at the tracepoint
+	const char *te_name;
+	uint32_t te_a;
+	uint32_t te_b;
+	uint32_t te_phase;	// TRACE_PH_*
+};
+
+// Written only by its own CPU, so no lock is needed.
+struct TraceRing {
+	uint32_t tr_head;	// total events ever written
+	struct TraceEvent tr_events[TRACE_NEVENTS];
+} ____cacheline_aligned;
+
+extern bool trace_enabled;
+
+void trace_record(const char *name, uint32_t a, uint32_t b, int phase);
+void trace_clear(void);
+void trace_dump(void);
+
+#define TRACE_POINT(name, a, b, phase)					\
+	do {								\
+		if (__builtin_expect(trace_enabled, 0))			\
+			trace_record(name, (uint32_t) (a),		\
+				     (uint32_t) (b), phase);		\
+	} while (0)
+
+#define TRACE_EVENT(name, a, b)	TRACE_POINT(name, a, b, TRACE_PH_INSTANT)
+#define TRACE_BEGIN(name)	TRACE_POINT(name, 0, 0, TRACE_PH_BEGIN)
+#define TRACE_END(name)		TRACE_POINT(name, 0, 0, TRACE_PH_END)
+
+#endif	// !JOS_KERN_TRACE_H
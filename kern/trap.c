@@ -0,0 +1,202 @@
+#include <inc/mmu.h>
+#include <inc/memlayout.h>
+#include <inc/x86.h>
+#include <inc/assert.h>
+
+#include <kern/trap.h>
+#include <kern/console.h>
+#include <kern/monitor.h>
+#include <kern/perf.h>
+#include <kern/pmap.h>
+
+// Global descriptor table.
+//
+// Set up global descriptor table (GDT) with separate segments for
+// kernel mode and user mode.  Segments serve many purposes on the x86.
+// We don't use any of their memory-mapping capabilities, but we need
+// them to switch privilege levels.
+//
+// The boot loader's GDT lives in low memory, which the kernel will
+// not keep mapped, so we load our own before enabling interrupts.
+struct Segdesc gdt[] =
+{
+	// 0x0 - unused (always faults -- for trapping NULL far pointers)
+	SEG_NULL,
+
+	// 0x8 - kernel code segment
+	[GD_KT >> 3] = SEG(STA_X | STA_R, 0x0, 0xffffffff, 0),
+
+	// 0x10 - kernel data segment
+	[GD_KD >> 3] = SEG(STA_W, 0x0, 0xffffffff, 0),
+
+	// 0x18 - user code segment
+	[GD_UT >> 3] = SEG(STA_X | STA_R, 0x0, 0xffffffff, 3),
+
+	// 0x20 - user data segment
+	[GD_UD >> 3] = SEG(STA_W, 0x0, 0xffffffff, 3),
+
+	// 0x28 - tss, initialized once we have user environments
+	[GD_TSS0 >> 3] = SEG_NULL
+};
+
+struct Pseudodesc gdt_pd = {
+	sizeof(gdt) - 1, (unsigned long) gdt
+};
+
+/* Interrupt descriptor table.  (Must be built at run time because
+ * shifted function addresses can't be represented in relocation records.)
+ */
+struct Gatedesc idt[256] = { { 0 } };
+struct Pseudodesc idt_pd = {
+	sizeof(idt) - 1, (uint32_t) idt
+};
+
+
+static const char *trapname(int trapno)
+{
+	static const char * const excnames[] = {
+		"Divide error",
+		"Debug",
+		"Non-Maskable Interrupt",
+		"Breakpoint",
+		"Overflow",
+		"BOUND Range Exceeded",
+		"Invalid Opcode",
+		"Device Not Available",
+		"Double Fault",
+		"Coprocessor Segment Overrun",
+		"Invalid TSS",
+		"Segment Not Present",
+		"Stack Fault",
+		"General Protection",
+		"Page Fault",
+		"(unknown trap)",
+		"x87 FPU Floating-Point Error",
+		"Alignment Check",
+		"Machine-Check",
+		"SIMD Floating-Point Exception"
+	};
+
+	if (trapno < ARRAY_SIZE(excnames))
+		return excnames[trapno];
+	if (trapno >= IRQ_OFFSET && trapno < IRQ_OFFSET + 16)
+		return "Hardware Interrupt";
+	return "(unknown trap)";
+}
+
+
+void
+trap_init(void)
+{
+	extern void th_divide(), th_debug(), th_nmi(), th_brkpt(),
+		th_oflow(), th_bound(), th_illop(), th_device(),
+		th_dblflt(), th_tss(), th_segnp(), th_stack(), th_gpflt(),
+		th_pgflt(), th_fperr(), th_align(), th_mchk(), th_simderr(),
+		th_irq_timer(), th_irq_spurious();
+
+	SETGATE(idt[T_DIVIDE], 0, GD_KT, th_divide, 0);
+	SETGATE(idt[T_DEBUG], 0, GD_KT, th_debug, 0);
+	SETGATE(idt[T_NMI], 0, GD_KT, th_nmi, 0);
+	SETGATE(idt[T_BRKPT], 0, GD_KT, th_brkpt, 0);
+	SETGATE(idt[T_OFLOW], 0, GD_KT, th_oflow, 0);
+	SETGATE(idt[T_BOUND], 0, GD_KT, th_bound, 0);
+	SETGATE(idt[T_ILLOP], 0, GD_KT, th_illop, 0);
+	SETGATE(idt[T_DEVICE], 0, GD_KT, th_device, 0);
+	SETGATE(idt[T_DBLFLT], 0, GD_KT, th_dblflt, 0);
+	SETGATE(idt[T_TSS], 0, GD_KT, th_tss, 0);
+	SETGATE(idt[T_SEGNP], 0, GD_KT, th_segnp, 0);
+	SETGATE(idt[T_STACK], 0, GD_KT, th_stack, 0);
+	SETGATE(idt[T_GPFLT], 0, GD_KT, th_gpflt, 0);
+	SETGATE(idt[T_PGFLT], 0, GD_KT, th_pgflt, 0);
+	SETGATE(idt[T_FPERR], 0, GD_KT, th_fperr, 0);
+	SETGATE(idt[T_ALIGN], 0, GD_KT, th_align, 0);
+	SETGATE(idt[T_MCHK], 0, GD_KT, th_mchk, 0);
+	SETGATE(idt[T_SIMDERR], 0, GD_KT, th_simderr, 0);
+
+	SETGATE(idt[IRQ_OFFSET + IRQ_TIMER], 0, GD_KT, th_irq_timer, 0);
+	SETGATE(idt[IRQ_OFFSET + IRQ_SPURIOUS], 0, GD_KT, th_irq_spurious, 0);
+
+	// Per-CPU setup
+	trap_init_percpu();
+}
+
+// Load the GDT and IDT on this CPU.
+void
+trap_init_percpu(void)
+{
+	lgdt(&gdt_pd);
+	// The kernel never uses GS or FS, so we leave those set to
+	// the user data segment.
+	asm volatile("movw %%ax,%%gs" : : "a" (GD_UD|3));
+	asm volatile("movw %%ax,%%fs" : : "a" (GD_UD|3));
+	// The kernel does use ES, DS, and SS.  We'll change between
+	// the kernel and user data segments as needed.
+	asm volatile("movw %%ax,%%es" : : "a" (GD_KD));
+	asm volatile("movw %%ax,%%ds" : : "a" (GD_KD));
+	asm volatile("movw %%ax,%%ss" : : "a" (GD_KD));
+	// Load the kernel text segment into CS.
+	asm volatile("ljmp %0,$1f\n 1:\n" : : "i" (GD_KT));
+
+	lidt(&idt_pd);
+}
+
+void
+print_trapframe(struct Trapframe *tf)
+{
+	cprintf("TRAP frame at %p\n", tf);
+	print_regs(&tf->tf_regs);
+	cprintf("  es   0x----%04x\n", tf->tf_es);
+	cprintf("  ds   0x----%04x\n", tf->tf_ds);
+	cprintf("  trap 0x%08x %s\n", tf->tf_trapno, trapname(tf->tf_trapno));
+	if (tf->tf_trapno == T_PGFLT)
+		cprintf("  cr2  0x%08x\n", rcr2());
+	cprintf("  err  0x%08x\n", tf->tf_err);
+	cprintf("  eip  0x%08x\n", tf->tf_eip);
+	cprintf("  cs   0x----%04x\n", tf->tf_cs);
+	cprintf("  flag 0x%08x\n", tf->tf_eflags);
+}
+
+void
+print_regs(struct PushRegs *regs)
+{
+	cprintf("  edi  0x%08x\n", regs->reg_edi);
+	cprintf("  esi  0x%08x\n", regs->reg_esi);
+	cprintf("  ebp  0x%08x\n", regs->reg_ebp);
+	cprintf("  oesp 0x%08x\n", regs->reg_oesp);
+	cprintf("  ebx  0x%08x\n", regs->reg_ebx);
+	cprintf("  edx  0x%08x\n", regs->reg_edx);
+	cprintf("  ecx  0x%08x\n", regs->reg_ecx);
+	cprintf("  eax  0x%08x\n", regs->reg_eax);
+}
+
+void
+trap(struct Trapframe *tf)
+{
+	// The environment may have set DF and some versions
+	// of GCC rely on DF being clear
+	asm volatile("cld" ::: "cc");
+
+	// Handle spurious interrupts
+	// The hardware sometimes raises these because of noise on the
+	// IRQ line or other reasons. We don't care.
+	if (tf->tf_trapno == IRQ_OFFSET + IRQ_SPURIOUS) {
+		cprintf("Spurious interrupt on irq 7\n");
+		print_trapframe(tf);
+		return;
+	}
+
+	if (tf->tf_trapno == IRQ_OFFSET + IRQ_TIMER) {
+		perf_sample(tf);
+		return;
+	}
+
+	// A write to a copy-on-write page, from either mode.
+	if (tf->tf_trapno == T_PGFLT
+	    && (tf->tf_err & (FEC_PR | FEC_WR)) == (FEC_PR | FEC_WR)
+	    && page_cow_fault(curpgdir(), (void *) rcr2()) == 0)
+		return;
+
+	// We only ever trap from the kernel, so anything else is a bug.
+	print_trapframe(tf);
+	panic("unhandled trap in kernel");
+}
@@ -1,8 +1,9 @@
 #include <inc/stdio.h>
 #include <inc/error.h>
+#include <inc/cache.h>
 
 #define BUFLEN 1024
-static char buf[BUFLEN];
+static char buf[BUFLEN] ____cacheline_aligned;
 
 char *
 readline(const char *prompt)